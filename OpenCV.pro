@@ -11,17 +11,80 @@ LIBS += "C:\OpenCV2.0\lib\libcxcore200.dll.a"
 LIBS += "C:\OpenCV2.0\lib\libhighgui200.dll.a"
 
 # LIBS += "C:\OpenCV2.0\lib\libcvaux200.dll.a"
+
+# shm_open of the frame export
+unix:!macx:LIBS += -lrt
+
+# Allocation tracking build (qmake CONFIG+=alloccheck), counts the heap allocations for --alloc-check
+alloccheck {
+    DEFINES += ALLOC_CHECK
+    CONFIG += console
+}
+
 SOURCES += main.cpp \
     camerawindow.cpp \
     opencvwidget.cpp \
     camshift.cpp \
     camshiftdialog.cpp \
-    facedetect.cpp
+    facedetect.cpp \
+    skinfilter.cpp \
+    detectcontroller.cpp \
+    frameqos.cpp \
+    processingpool.cpp \
+    snapshotwriter.cpp \
+    prerollbuffer.cpp \
+    eventrecorder.cpp \
+    tracklog.cpp \
+    frameimages.cpp \
+    frame.cpp \
+    framesource.cpp \
+    allocstats.cpp \
+    alloccheck.cpp \
+    frameexport.cpp \
+    flowtracker.cpp \
+    startup.cpp \
+    videoanalysis.cpp \
+    visionkernels.cpp \
+    cpudispatch.cpp \
+    kernelcheck.cpp \
+    idlethrottle.cpp \
+    framedump.cpp \
+    replaybench.cpp \
+    capturethread.cpp \
+    framepipeline.cpp \
+    camshiftcheck.cpp
 HEADERS += camerawindow.h \
     opencvwidget.h \
     camshift.h \
     version.h \
     camshiftdialog.h \
-    facedetect.h
+    facedetect.h \
+    skinfilter.h \
+    detectcontroller.h \
+    frameqos.h \
+    processingpool.h \
+    snapshotwriter.h \
+    prerollbuffer.h \
+    eventrecorder.h \
+    tracklog.h \
+    frameimages.h \
+    frame.h \
+    framesource.h \
+    allocstats.h \
+    alloccheck.h \
+    frameexport.h \
+    flowtracker.h \
+    startup.h \
+    videoanalysis.h \
+    visionkernels.h \
+    cpudispatch.h \
+    kernelcheck.h \
+    idlethrottle.h \
+    framedump.h \
+    replaybench.h \
+    capturethread.h \
+    framepipeline.h \
+    sleeper.h \
+    camshiftcheck.h
 RESOURCES += resources.qrc
 FORMS += camshiftdialog.ui
@@ -0,0 +1,158 @@
+/*
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include "alloccheck.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QPixmap>
+#include <QStringList>
+
+#include "framesource.h"
+#include "frame.h"
+#include "frameqos.h"
+
+static const char *stageNames[AllocCheck::StageCount] = { "capture", "detection", "tracking", "recording", "display" };
+
+AllocCheck::AllocCheck() {
+    mFrames = 0;
+    mBudget = 0;
+    mDetection = false;
+    mRecording = false;
+    mYuyv = false;
+}
+
+// Called by the pipeline, from the worker for detection and tracking (it's waited for)
+void AllocCheck::stageStarted(int stage) {
+    switch(stage) {
+        case FramePipeline::Detection: mark(Detection); break;
+        case FramePipeline::Tracking: mark(Tracking); break;
+        case FramePipeline::Recording: mark(Recording); break;
+    }
+}
+
+void AllocCheck::mark(Stage stage) {
+    mMarks[stage] = AllocStats::current();
+    mMarked[stage] = true;
+}
+
+bool AllocCheck::run(int frames, int warmup, double budget, bool yuyv) {
+    SyntheticSource synthetic;
+    YuyvSource yuyvSource;
+    FrameSource *source = yuyv ? (FrameSource *)&yuyvSource : &synthetic;
+    IplImage *first = source->queryFrame();
+    CvSize size = cvGetSize(first);
+    mYuyv = yuyv;
+
+    // The pipeline of a camera, waiting for the workers on each frame
+    FramePool pool(size, 8, 3, 4, yuyv);
+    FramePipeline pipeline;
+    pipeline.setFrameSize(size);
+    pipeline.setSynchronous(true);
+    pipeline.setProbe(this);
+    pipeline.setFaceDetectFlags(CV_HAAR_FIND_BIGGEST_OBJECT);
+    QFileInfo cascadeFile("haarcascades/haarcascade_frontalface_alt2.xml");
+    if(cascadeFile.exists()) pipeline.setCascadeFile(cascadeFile.absoluteFilePath());
+    mDetection = !pipeline.cascadeFile().isEmpty();
+    pipeline.setDetectFaces(mDetection);
+    pipeline.setTrackFace(true);
+    QString videoFile = QDir::temp().filePath("alloccheck.avi"), logFile = QDir::temp().filePath("alloccheck.trk");
+    mRecording = pipeline.startRecording(videoFile);
+
+    QImage image(QSize(size.width, size.height), QImage::Format_RGB888);
+    IplImage *display = cvCreateImageHeader(size, 8, 3);
+    display->imageData = (char *)image.bits();
+
+    for(int i = 0; i < StageCount; i++) mCounts[i] = AllocCount();
+    mFrames = 0;
+    mBudget = budget;
+
+    for(int i = 0; i < frames; i++) {
+        for(int stage = 0; stage < StageCount; stage++) mMarked[stage] = false;
+
+        mark(Capture);
+        source->grabFrame();
+        Frame frame = pool.acquire();
+        FrameInfo info;
+        info.sequence = i;
+        info.timestamp = FrameQoS::now();
+        frame.fill(source->retrieveFrame(), source->retrieveLuma(), info);
+
+        // The tracker starts on the face the source has drawn, so it doesn't depend on the detection
+        if(i == 0) pipeline.startTracking(yuyv ? yuyvSource.faceRect() : synthetic.faceRect());
+        FrameResults results;
+        FrameTiming timing = pipeline.feed(frame, &results);
+
+        mark(Display);
+        cvCvtColor(frame.image(), display, CV_BGR2RGB);
+        if(results.hasBox) cvEllipseBox(display, results.box, cvScalar(255, 0, 0), 3, CV_AA, 0);
+        QPixmap pixmap = QPixmap::fromImage(image);
+        pipeline.qos()->endFrame(timing);
+        frame.release();
+
+        mMarks[StageCount] = AllocStats::current();
+
+        // A stage the pipeline skipped took nothing
+        for(int stage = StageCount - 1; stage >= 0; stage--)
+            if(!mMarked[stage]) mMarks[stage] = mMarks[stage + 1];
+
+        if(i < warmup) continue;
+        for(int stage = 0; stage < StageCount; stage++) {
+            mCounts[stage].allocations += mMarks[stage + 1].allocations - mMarks[stage].allocations;
+            mCounts[stage].bytes += mMarks[stage + 1].bytes - mMarks[stage].bytes;
+        }
+        mFrames++;
+    }
+
+    pipeline.stopRecording();
+    QFile::remove(videoFile);
+    QFile::remove(logFile);
+    cvReleaseImageHeader(&display);
+
+    double allocations = 0;
+    for(int stage = 0; stage < StageCount; stage++) allocations += mCounts[stage].allocations;
+    return mBudget < 0 || mFrames == 0 || allocations / mFrames <= mBudget;
+}
+
+// Allocations and bytes per steady state frame of each stage
+QString AllocCheck::report() const {
+    QStringList lines;
+    double allocations = 0, bytes = 0;
+    int frames = qMax(1, mFrames);
+
+    if(!AllocStats::isEnabled()) lines << "Allocation tracking is disabled (build with CONFIG+=alloccheck)";
+    if(!mDetection) lines << "No cascade file found, detection skipped";
+    if(!mRecording) lines << "Can't write the video (no codec?), recording skipped";
+    if(mYuyv) lines << "YUYV source, detection on its luma plane";
+
+    for(int stage = 0; stage < StageCount; stage++) {
+        allocations += mCounts[stage].allocations;
+        bytes += mCounts[stage].bytes;
+        lines << QString("%1: %2 allocations, %3 bytes per frame").arg(stageNames[stage], -10)
+                 .arg((double)mCounts[stage].allocations / frames, 0, 'f', 2)
+                 .arg((double)mCounts[stage].bytes / frames, 0, 'f', 0);
+    }
+
+    lines << QString("total: %1 allocations, %2 bytes per frame over %3 frames").arg(allocations / frames, 0, 'f', 2)
+             .arg(bytes / frames, 0, 'f', 0).arg(mFrames)
+             + (mBudget < 0 ? QString(" (no budget)") : QString(" (budget %1)").arg(mBudget));
+
+    return lines.join("\n");
+}
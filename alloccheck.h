@@ -0,0 +1,58 @@
+/*
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef ALLOCCHECK_H
+#define ALLOCCHECK_H
+
+#include <QString>
+
+#include "allocstats.h"
+#include "framepipeline.h"
+
+// Feeds a synthetic source to a FramePipeline in synchronous mode, so its stages run one after the other,
+// and counts the heap allocations of each one. After the warm-up frames nothing should be allocated beyond
+// the budget (allocations per frame). With 'yuyv' the source is the YUYV one and detection runs on its luma
+// plane, like with a camera that delivers it.
+class AllocCheck : public PipelineProbe {
+    public:
+        enum Stage { Capture, Detection, Tracking, Recording, Display, StageCount };
+
+        AllocCheck();
+
+    public:
+        // Returns true if the steady state stays within the budget (a negative budget always passes)
+        bool run(int frames, int warmup, double budget, bool yuyv = false);
+        QString report() const;
+
+        void stageStarted(int stage);
+
+    private:
+        void mark(Stage stage);
+
+    private:
+        AllocCount mMarks[StageCount + 1];  // Counts when each stage of the current frame started
+        bool mMarked[StageCount];
+        AllocCount mCounts[StageCount];     // Steady state totals
+        int mFrames;                        // Steady state frames
+        double mBudget;
+        bool mDetection;                    // A cascade was found
+        bool mRecording;                    // The video could be written
+        bool mYuyv;
+};
+
+#endif // ALLOCCHECK_H
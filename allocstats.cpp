@@ -0,0 +1,141 @@
+/*
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include "allocstats.h"
+
+#include <QAtomicInt>
+
+#include <stdlib.h>
+#include <new>
+
+#include "cv.h"
+
+// Plain atomics, malloc can be called before the static constructors run
+static QBasicAtomicInt allocationCount = Q_BASIC_ATOMIC_INITIALIZER(0);
+static QBasicAtomicInt allocationBytes = Q_BASIC_ATOMIC_INITIALIZER(0);
+
+AllocCount::AllocCount() {
+    allocations = bytes = 0;
+}
+
+void AllocStats::count(size_t size) {
+    allocationCount.fetchAndAddRelaxed(1);
+    allocationBytes.fetchAndAddRelaxed((int)size);
+}
+
+AllocCount AllocStats::current() {
+    AllocCount count;
+    count.allocations = (unsigned int)(int)allocationCount;
+    count.bytes = (unsigned int)(int)allocationBytes;
+    return count;
+}
+
+#ifdef ALLOC_CHECK
+
+bool AllocStats::isEnabled() {
+    return true;
+}
+
+#ifdef __GLIBC__
+
+// The malloc family is replaced for the whole process (Qt and OpenCV libraries included)
+extern "C" {
+    void *__libc_malloc(size_t size);
+    void *__libc_calloc(size_t count, size_t size);
+    void *__libc_realloc(void *pointer, size_t size);
+    void *__libc_memalign(size_t alignment, size_t size);
+
+    void *malloc(size_t size) {
+        AllocStats::count(size);
+        return __libc_malloc(size);
+    }
+
+    void *calloc(size_t count, size_t size) {
+        AllocStats::count(count * size);
+        return __libc_calloc(count, size);
+    }
+
+    void *realloc(void *pointer, size_t size) {
+        AllocStats::count(size);
+        return __libc_realloc(pointer, size);
+    }
+
+    void *memalign(size_t alignment, size_t size) {
+        AllocStats::count(size);
+        return __libc_memalign(alignment, size);
+    }
+}
+
+void AllocStats::install() {
+}
+
+#else
+
+// Without a replaceable malloc we count operator new and the OpenCV allocator (Qt containers aren't counted)
+void *operator new(size_t size) throw(std::bad_alloc) {
+    AllocStats::count(size);
+    void *pointer = malloc(size ? size : 1);
+    if(!pointer) throw std::bad_alloc();
+    return pointer;
+}
+
+void *operator new[](size_t size) throw(std::bad_alloc) {
+    return operator new(size);
+}
+
+void operator delete(void *pointer) throw() {
+    free(pointer);
+}
+
+void operator delete[](void *pointer) throw() {
+    free(pointer);
+}
+
+// Same alignment as the default OpenCV allocator, the original pointer is stored before the block
+static void *countingAlloc(size_t size, void *) {
+    AllocStats::count(size);
+    uchar *block = (uchar *)malloc(size + sizeof(void *) + CV_MALLOC_ALIGN);
+    if(!block) return 0;
+
+    uchar **aligned = (uchar **)cvAlignPtr((uchar **)block + 1, CV_MALLOC_ALIGN);
+    aligned[-1] = block;
+    return aligned;
+}
+
+static int countingFree(void *pointer, void *) {
+    if(pointer) free(((uchar **)pointer)[-1]);
+    return 0;
+}
+
+// Must be called before OpenCV allocates anything
+void AllocStats::install() {
+    cvSetMemoryManager(countingAlloc, countingFree, 0);
+}
+
+#endif // __GLIBC__
+
+#else
+
+bool AllocStats::isEnabled() {
+    return false;
+}
+
+void AllocStats::install() {
+}
+
+#endif // ALLOC_CHECK
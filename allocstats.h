@@ -0,0 +1,43 @@
+/*
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef ALLOCSTATS_H
+#define ALLOCSTATS_H
+
+#include <stddef.h>
+
+// Heap allocations done by the process since it started (all threads). The counters only move on builds
+// with ALLOC_CHECK (qmake CONFIG+=alloccheck), where the allocators are replaced by counting ones:
+// malloc & co. on glibc (that covers new, Qt and OpenCV), operator new and the OpenCV allocator elsewhere.
+struct AllocCount {
+    AllocCount();
+
+    unsigned int allocations;
+    unsigned int bytes;         // Wraps around, only the differences are meaningful
+};
+
+class AllocStats {
+    public:
+        static bool isEnabled();
+        static void install();
+        static AllocCount current();
+
+        static void count(size_t size);
+};
+
+#endif // ALLOCSTATS_H
@@ -20,14 +20,20 @@
 
 #include <QFileDialog>
 #include <QSettings>
+#include <QFileInfo>
 #include <QMessageBox>
 #include <QDebug>
+#include <QGridLayout>
+#include <QtCore/qmath.h>
 
 CameraWindow::CameraWindow(QWidget *parent) : QMainWindow(parent) {
     setWindowIcon(QIcon(":/images/OpenCV.ico"));
     setMinimumSize(320, 240);
 
-    cvWidget = new OpenCVWidget(this);
+    QSettings settings("Kronen Software", "Qt + OpenCV");
+    mCascadeLoader = 0;
+    mCamerasReady = mSettingsRead = false;
+    createCameraWidgets(qMax(1, settings.value("Cameras", 1).toInt()));
     createCamShiftDialog();
 
     createActions();
@@ -35,48 +41,165 @@ CameraWindow::CameraWindow(QWidget *parent) : QMainWindow(parent) {
     createToolBar();
     createStatusBar();
 
+    // The window is shown while the cameras open and the cascade loads, the actions are enabled when they're ready
+    videoAction->setEnabled(false);
+    rawAction->setEnabled(false);
+    autoRecordAction->setEnabled(false);
+    screenshotAction->setEnabled(false);
+    burstAction->setEnabled(false);
+    detectFacesAction->setEnabled(false);
+    trackFaceAction->setEnabled(false);
+    settingsMenu->setEnabled(false);
+    flagsMenu->setEnabled(false);
+
+    // The cascade of the settings, or the default one
+    QString cascadeFile = settings.value("CascadeFile").toString();
+    if(!QFileInfo(cascadeFile).exists()) cascadeFile = QFileInfo("haarcascades/haarcascade_frontalface_alt2.xml").absoluteFilePath();
+    if(QFileInfo(cascadeFile).exists()) {
+        mCascadeLoader = new CascadeLoader(cascadeFile);
+        connect(mCascadeLoader, SIGNAL(finished()), this, SLOT(cascadeLoaded()));
+        mCascadeLoader->start();
+    }
+
+    statusLabel->setText(mCascadeLoader ? tr("Opening cameras and loading the cascade...") : tr("Opening cameras..."));
+}
+
+// A camera finished opening. When all of them did, the ones that couldn't be opened are removed
+void CameraWindow::cameraReady() {
+    if(--mCamerasPending > 0) return;
+
+    QList<OpenCVWidget *> active;
+    foreach(OpenCVWidget *widget, cvWidgets) if(widget->isCaptureActive()) active.append(widget);
+
     // We check if OpenCV was able to detect a compatible device
-    if(!cvWidget->isCaptureActive()) {
+    if(active.isEmpty()) {
         QMessageBox::warning(this, tr("Qt + OpenCV"),
                              tr("Can't detect a camera connected to the PC.\n"
                                 "This program doesn't provide any option\n"
                                 "to configure the device."), QMessageBox::Close);
+        return;
+    }
 
-        videoAction->setEnabled(false);
-        screenshotAction->setEnabled(false);
-        settingsMenu->setEnabled(false);
-        flagsMenu->setEnabled(false);
-    } else {
-        readSettings();
-        statusLabel->setText(QString("OpenCV Face Detection. (w:%1 h:%2)").arg(cvWidget->width()).arg(cvWidget->height()));
+    // The sender may be one of them, so they're deleted later. They're disconnected now: readSettings() can
+    // move the sliders before that
+    foreach(OpenCVWidget *widget, cvWidgets) {
+        if(widget->isCaptureActive()) continue;
+        mCamShiftDialog->vMinSlider->disconnect(widget);
+        mCamShiftDialog->sMinSlider->disconnect(widget);
+        widget->deleteLater();
     }
+    cvWidgets = active;
+    cvWidget = cvWidgets.first();
+    if(cvWidgets.size() > 1) foreach(OpenCVWidget *widget, cvWidgets) widget->setShowMetrics(true);
+
+    videoAction->setEnabled(true);
+    rawAction->setEnabled(true);
+    screenshotAction->setEnabled(true);
+    burstAction->setEnabled(true);
+    mCamerasReady = true;
+
+    statusLabel->setText(tr("%n camera(s) ready", "", cvWidgets.size()));
+    startupStep();
+}
+
+void CameraWindow::cascadeLoaded() {
+    if(mCascadeLoader->isLoaded()) {
+        // The widgets take the model loaded from the cache
+        foreach(OpenCVWidget *widget, cvWidgets) widget->setCascadeFile(mCascadeLoader->cascadeFile());
+        statusLabel->setText(tr("Cascade loaded in %1 ms").arg(mCascadeLoader->loadTime(), 0, 'f', 0));
+    } else statusLabel->setText(tr("Can't load the cascade ") + mCascadeLoader->cascadeFile());
+
+    delete mCascadeLoader;
+    mCascadeLoader = 0;
+    startupStep();
+}
 
-    setCentralWidget(cvWidget);
+// The settings are applied and the rest of the actions enabled when the cameras and the cascade are ready
+void CameraWindow::startupStep() {
+    if(!mCamerasReady || mCascadeLoader || mSettingsRead) return;
+
+    autoRecordAction->setEnabled(true);
+    detectFacesAction->setEnabled(true);
+    trackFaceAction->setEnabled(true);
+    settingsMenu->setEnabled(true);
+    flagsMenu->setEnabled(true);
+
+    readSettings();
+    mSettingsRead = true;
+    statusLabel->setText(QString("OpenCV Face Detection. (w:%1 h:%2)").arg(cvWidget->width()).arg(cvWidget->height()));
+}
+
+// One widget for each camera, several cameras are shown in a grid.
+// All of them share the loaded cascade and the detection/tracking workers.
+// The cameras open on the background, cameraReady() is called for each one
+void CameraWindow::createCameraWidgets(int cameras) {
+    if(cameras > 1) {
+        for(int i = 0; i < cameras; i++) cvWidgets.append(new OpenCVWidget(i, this));
+    } else cvWidgets.append(new OpenCVWidget(CV_CAP_ANY, this));
+
+    cvWidget = cvWidgets.first();
+    mCamerasPending = cvWidgets.size();
+    foreach(OpenCVWidget *widget, cvWidgets) connect(widget, SIGNAL(cameraReady(bool)), this, SLOT(cameraReady()));
+
+    if(cvWidgets.size() == 1) {
+        setCentralWidget(cvWidget);
+    } else {
+        QWidget *grid = new QWidget(this);
+        QGridLayout *layout = new QGridLayout(grid);
+        int columns = qCeil(qSqrt(cvWidgets.size()));
+        for(int i = 0; i < cvWidgets.size(); i++) layout->addWidget(cvWidgets.at(i), i / columns, i % columns);
+        setCentralWidget(grid);
+    }
 }
 
 void CameraWindow::closeEvent(QCloseEvent *event) {
-    writeSettings();
-    delete cvWidget;
+    // Closed before the startup finished, the widgets don't have the settings to save
+    if(mSettingsRead) writeSettings();
+    if(mCascadeLoader) delete mCascadeLoader;
+    qDeleteAll(cvWidgets);
+    cvWidgets.clear();
     if(mCamShiftDialog) delete mCamShiftDialog;
     event->accept();
 }
 
 void CameraWindow::saveScreenshot() {
-    cvWidget->saveScreenshot();
+    foreach(OpenCVWidget *widget, cvWidgets) widget->saveScreenshot();
+}
+
+// Save the next 10 frames at full rate
+void CameraWindow::saveBurst() {
+    foreach(OpenCVWidget *widget, cvWidgets) widget->saveScreenshot(10);
 }
 
 // Start/Stop writing the webcam frames to a video file
 void CameraWindow::writeVideo() {
     if(videoAction->isChecked()) {
         videoAction->setIcon(QIcon(":/images/icon_stopvideo.png"));
-        cvWidget->videoWrite();
+        foreach(OpenCVWidget *widget, cvWidgets) widget->videoWrite();
     } else {
         videoAction->setIcon(QIcon(":/images/icon_video.png"));
-        cvWidget->videoStop();
+        foreach(OpenCVWidget *widget, cvWidgets) widget->videoStop();
     }
     statusLabel->setText("Writing Video");
 }
 
+// Start/Stop dumping the raw frames, for replaying them without a camera
+void CameraWindow::writeRaw() {
+    foreach(OpenCVWidget *widget, cvWidgets) {
+        if(rawAction->isChecked()) widget->rawWrite();
+            else widget->rawStop();
+    }
+    if(!rawAction->isChecked()) statusLabel->setText("Raw frames written");
+}
+
+// Record only when there are faces, including the seconds before they appear
+void CameraWindow::setAutoRecord() {
+    // Faces are needed to trigger the recordings
+    if(autoRecordAction->isChecked() && !cvWidget->isFaceDetectAvalaible()) setCascadeFile();
+
+    foreach(OpenCVWidget *widget, cvWidgets) widget->setAutoRecord(autoRecordAction->isChecked());
+}
+
 // Start/Stop detect face mode
 void CameraWindow::detectFaces() {
     // We don't track and detect at the same time
@@ -85,12 +208,14 @@ void CameraWindow::detectFaces() {
         if(!cvWidget->isFaceDetectAvalaible()) setCascadeFile();
 
         // Don't track and detect at the same time
-        cvWidget->setTrackFace(false);
-        cvWidget->setDetectFaces(true);
+        foreach(OpenCVWidget *widget, cvWidgets) {
+            widget->setTrackFace(false);
+            widget->setDetectFaces(true);
+        }
         trackFaceAction->setChecked(false);
 
         statusLabel->setText("Detecting Faces");
-    } else cvWidget->setDetectFaces(false);
+    } else foreach(OpenCVWidget *widget, cvWidgets) widget->setDetectFaces(false);
 }
 
 // Start/Stop track face mode
@@ -104,12 +229,15 @@ void CameraWindow::trackFace() {
         flagsMenu->setEnabled(false);
 
         // Don't track and detect at the same time
-        cvWidget->setDetectFaces(false);
-        cvWidget->setTrackFace(true);
+        FramePipeline::Tracker tracker = FramePipeline::Tracker(trackerGroup->checkedAction()->data().toInt());
+        foreach(OpenCVWidget *widget, cvWidgets) {
+            widget->setDetectFaces(false);
+            widget->setTrackFace(true, tracker);
+        }
 
         statusLabel->setText("Tracking Face");
     } else {
-        cvWidget->setTrackFace(false);
+        foreach(OpenCVWidget *widget, cvWidgets) widget->setTrackFace(false);
         flagsMenu->setEnabled(true);
     }
 }
@@ -117,29 +245,74 @@ void CameraWindow::trackFace() {
 // Dialog to calibrate CamShift through vMin and sMin.
 // These variables define thresholds for ignoring pixels that are too close to neutral.
 // vMin sets the threshold for "almost black," and sMin for "almost gray."
+// The skin prefilter of the face detection uses the same thresholds.
 void CameraWindow::createCamShiftDialog() {
     mCamShiftDialog = new CamShiftDialog(this);
 
-    connect(mCamShiftDialog->vMinSlider, SIGNAL(valueChanged(int)), cvWidget, SLOT(setCamShiftVMin(int)));
-    connect(mCamShiftDialog->sMinSlider, SIGNAL(valueChanged(int)), cvWidget, SLOT(setCamShiftSMin(int)));
+    foreach(OpenCVWidget *widget, cvWidgets) {
+        connect(mCamShiftDialog->vMinSlider, SIGNAL(valueChanged(int)), widget, SLOT(setCamShiftVMin(int)));
+        connect(mCamShiftDialog->sMinSlider, SIGNAL(valueChanged(int)), widget, SLOT(setCamShiftSMin(int)));
+    }
 }
 
 void CameraWindow::readSettings() {
     QSettings settings("Kronen Software", "Qt + OpenCV");
     if(settings.value("FlipH").toBool()) {
-        cvWidget->switchFlipH();
+        flipHorizontally();
         flipHorizontallyAction->setChecked(true);
     }
     if(settings.value("FlipV").toBool()) {
-        cvWidget->switchFlipV();
+        flipVertically();
         flipVerticallyAction->setChecked(true);
     }
-    QString cascadeFile = settings.value("CascadeFile").toString();
-    if(QFileInfo(cascadeFile).exists()) cvWidget->setCascadeFile(cascadeFile);
+    if(settings.value("SkinFilter").toBool()) {
+        skinFilterAction->setChecked(true);
+        setSkinFilter();
+    }
+    if(settings.value("QoS").toBool()) {
+        qosAction->setChecked(true);
+        setQoS();
+    }
+    if(settings.value("IdleThrottle").toBool()) {
+        idleThrottleAction->setChecked(true);
+        setIdleThrottle();
+    }
+    if(settings.value("Export").toBool()) {
+        exportAction->setChecked(true);
+        setExport();
+    }
+    settings.beginGroup("AutoRecord");
+    foreach(OpenCVWidget *widget, cvWidgets)
+        widget->setAutoRecordTimes(settings.value("PreRoll", 3).toDouble(), settings.value("Timeout", 5).toDouble());
+    if(settings.value("Enabled").toBool()) {
+        autoRecordAction->setChecked(true);
+        setAutoRecord();
+    }
+    settings.endGroup();
+    int budget = settings.value("DetectBudget").toInt();
+    foreach(QAction *action, budgetGroup->actions()) {
+        if(action->data().toInt() == budget) {
+            action->setChecked(true);
+            setDetectBudget(action);
+        }
+    }
+
+    int tracker = settings.value("Tracker", FramePipeline::CamShiftTracker).toInt();
+    foreach(QAction *action, trackerGroup->actions())
+        if(action->data().toInt() == tracker) action->setChecked(true);
 
     settings.beginGroup("CamShift");
     mCamShiftDialog->vMinSlider->setValue(settings.value("Vmin").toInt());
     mCamShiftDialog->sMinSlider->setValue(settings.value("Smin").toInt());
+    camshiftPredictionAction->setChecked(settings.value("Prediction", true).toBool());
+    setCamShiftPrediction();
+    int mode = settings.value("Mode", CamShift::FusedMode).toInt();
+    foreach(QAction *action, camshiftModeGroup->actions()) {
+        if(action->data().toInt() == mode) {
+            action->setChecked(true);
+            setCamShiftMode(action);
+        }
+    }
     settings.endGroup();
 }
 
@@ -148,10 +321,19 @@ void CameraWindow::writeSettings() {
     settings.setValue("FlipH", cvWidget->flipH());
     settings.setValue("FlipV", cvWidget->flipV());
     if(!(cvWidget->cascadeFile().isEmpty())) settings.setValue("CascadeFile", cvWidget->cascadeFile());
+    settings.setValue("SkinFilter", cvWidget->isSkinFilterEnabled());
+    settings.setValue("DetectBudget", int(cvWidget->detectBudget()));
+    settings.setValue("QoS", cvWidget->isQoSEnabled());
+    settings.setValue("IdleThrottle", cvWidget->isIdleThrottleEnabled());
+    settings.setValue("Export", cvWidget->isExportEnabled());
+    settings.setValue("Tracker", trackerGroup->checkedAction()->data().toInt());
+    settings.setValue("AutoRecord/Enabled", cvWidget->isAutoRecord());
 
     settings.beginGroup("CamShift");
     settings.setValue("Vmin", cvWidget->camshiftVMin());
     settings.setValue("Smin", cvWidget->camshiftSMin());
+    settings.setValue("Mode", int(cvWidget->camshiftMode()));
+    settings.setValue("Prediction", cvWidget->camshiftPrediction());
     settings.endGroup();
 }
 
@@ -162,17 +344,58 @@ void CameraWindow::setCascadeFile() {
     QString cascadeFile = QFileDialog::getOpenFileName(this, tr("Choose Cascade File"), "./haarcascades",
                                                        tr("Cascade Files (*.xml)"));
     if(!cascadeFile.isNull()) {
-        cvWidget->setCascadeFile(cascadeFile);
+        foreach(OpenCVWidget *widget, cvWidgets) widget->setCascadeFile(cascadeFile);
         statusLabel->setText(cascadeFile + "loaded");
     }
 }
 
+void CameraWindow::setSkinFilter() {
+    foreach(OpenCVWidget *widget, cvWidgets) widget->setSkinFilter(skinFilterAction->isChecked());
+}
+
+// Latency budget per detection, the detection parameters adapt to it at runtime
+void CameraWindow::setDetectBudget(QAction *action) {
+    foreach(OpenCVWidget *widget, cvWidgets) widget->setDetectBudget(action->data().toInt());
+}
+
+void CameraWindow::setQoS() {
+    foreach(OpenCVWidget *widget, cvWidgets) widget->setQoS(qosAction->isChecked());
+}
+
+void CameraWindow::setIdleThrottle() {
+    foreach(OpenCVWidget *widget, cvWidgets) widget->setIdleThrottle(idleThrottleAction->isChecked());
+}
+
+void CameraWindow::setExport() {
+    foreach(OpenCVWidget *widget, cvWidgets) widget->setExport(exportAction->isChecked());
+}
+
+// The new tracker is used from now on, or the next time tracking starts
+void CameraWindow::setTracker() {
+    if(trackFaceAction->isChecked()) trackFace();
+}
+
+void CameraWindow::setCamShiftMode(QAction *action) {
+    foreach(OpenCVWidget *widget, cvWidgets) widget->setCamShiftMode(CamShift::Mode(action->data().toInt()));
+}
+
+void CameraWindow::setCamShiftPrediction() {
+    foreach(OpenCVWidget *widget, cvWidgets) widget->setCamShiftPrediction(camshiftPredictionAction->isChecked());
+}
+
+// The number of cameras is used on the next start
+void CameraWindow::setCameras(QAction *action) {
+    QSettings settings("Kronen Software", "Qt + OpenCV");
+    settings.setValue("Cameras", action->data().toInt());
+    statusLabel->setText(tr("Restart to use %n camera(s)", "", action->data().toInt()));
+}
+
 void CameraWindow::flipHorizontally() {
-    cvWidget->switchFlipH();
+    foreach(OpenCVWidget *widget, cvWidgets) widget->switchFlipH();
 }
 
 void CameraWindow::flipVertically() {
-    cvWidget->switchFlipV();
+    foreach(OpenCVWidget *widget, cvWidgets) widget->switchFlipV();
 }
 
 // Sends the checked flags to the widget to actualize the face detect mode
@@ -200,7 +423,7 @@ void CameraWindow::setFlags() {
         }
     }
 
-    cvWidget->setFaceDetectFlags(flags);
+    foreach(OpenCVWidget *widget, cvWidgets) widget->setFaceDetectFlags(flags);
 }
 
 void CameraWindow::unsetFlags() {
@@ -213,12 +436,20 @@ void CameraWindow::unsetFlags() {
 
 void CameraWindow::createMenu() {
     fileMenu = menuBar()->addMenu(tr("&File"));
+    fileMenu->addAction(screenshotAction);
+    fileMenu->addAction(burstAction);
+    fileMenu->addAction(autoRecordAction);
+    fileMenu->addAction(rawAction);
+    fileMenu->addSeparator();
     fileMenu->addAction(quitAction);
 
     settingsMenu = menuBar()->addMenu(tr("&Settings"));
 
     faceDetectMenu = settingsMenu->addMenu(tr("&DetectFace"));
     faceDetectMenu->addAction(cascadeFileAction);
+    faceDetectMenu->addAction(skinFilterAction);
+    budgetMenu = faceDetectMenu->addMenu(tr("Latency &Budget"));
+    budgetMenu->addActions(budgetGroup->actions());
     flagsMenu = faceDetectMenu->addMenu(tr("&Flags"));
     flagsMenu->addAction(findBiggestObjectAction);
     flagsMenu->addAction(doRoughSearchAction);
@@ -230,7 +461,18 @@ void CameraWindow::createMenu() {
     flagsMenu->addAction(unsetFlagsAction);
 
     settingsMenu->addSeparator();
+    trackerMenu = settingsMenu->addMenu(tr("&Tracker"));
+    trackerMenu->addActions(trackerGroup->actions());
     settingsMenu->addAction(camshiftDialogAction);
+    camshiftModeMenu = settingsMenu->addMenu(tr("CamShift &Mode"));
+    camshiftModeMenu->addActions(camshiftModeGroup->actions());
+    settingsMenu->addAction(camshiftPredictionAction);
+    settingsMenu->addSeparator();
+    settingsMenu->addAction(qosAction);
+    settingsMenu->addAction(idleThrottleAction);
+    settingsMenu->addAction(exportAction);
+    camerasMenu = settingsMenu->addMenu(tr("&Cameras"));
+    camerasMenu->addActions(camerasGroup->actions());
     settingsMenu->addSeparator();
     settingsMenu->addAction(flipHorizontallyAction);
     settingsMenu->addAction(flipVerticallyAction);
@@ -256,7 +498,8 @@ void CameraWindow::createStatusBar() {
 
     statusBar()->addPermanentWidget(statusLabel);
 
-    connect(cvWidget, SIGNAL(info(const QString &)), statusLabel, SLOT(setText(const QString &)));
+    foreach(OpenCVWidget *widget, cvWidgets)
+        connect(widget, SIGNAL(info(const QString &)), statusLabel, SLOT(setText(const QString &)));
 
     statusLabel->setText("OpenCV Face Detection");
 }
@@ -274,6 +517,11 @@ void CameraWindow::createActions() {
     screenshotAction->setStatusTip(tr("Take a screenshot from the camera"));
     connect(screenshotAction, SIGNAL(triggered()), this, SLOT(saveScreenshot()));
 
+    burstAction = new QAction(tr("Take a &Burst of Screenshots"), this);
+    burstAction->setShortcut(tr("Ctrl+B"));
+    burstAction->setStatusTip(tr("Take 10 consecutive screenshots from the camera"));
+    connect(burstAction, SIGNAL(triggered()), this, SLOT(saveBurst()));
+
     videoAction = new QAction(tr("Grab a Video"), this);
     videoAction->setIcon(QIcon(":/images/icon_video.png"));
     videoAction->setShortcut(tr("Ctrl+G"));
@@ -281,6 +529,16 @@ void CameraWindow::createActions() {
     videoAction->setCheckable(true);
     connect(videoAction, SIGNAL(triggered()), this, SLOT(writeVideo()));
 
+    rawAction = new QAction(tr("Record &Raw Frames"), this);
+    rawAction->setStatusTip(tr("Dump the frames without compression, to replay them later"));
+    rawAction->setCheckable(true);
+    connect(rawAction, SIGNAL(triggered()), this, SLOT(writeRaw()));
+
+    autoRecordAction = new QAction(tr("&Record on Face Detection"), this);
+    autoRecordAction->setStatusTip(tr("Record a video when faces appear, starting a few seconds before"));
+    autoRecordAction->setCheckable(true);
+    connect(autoRecordAction, SIGNAL(triggered()), this, SLOT(setAutoRecord()));
+
     detectFacesAction = new QAction(tr("Detect Faces"), this);
     detectFacesAction->setIcon(QIcon(":/images/icon_detectfaces.png"));
     detectFacesAction->setShortcut(tr("Ctrl+D"));
@@ -288,10 +546,10 @@ void CameraWindow::createActions() {
     detectFacesAction->setCheckable(true);
     connect(detectFacesAction, SIGNAL(triggered()), this, SLOT(detectFaces()));
 
-    trackFaceAction = new QAction(tr("Track a Face(CamShift)"), this);
+    trackFaceAction = new QAction(tr("Track a Face"), this);
     trackFaceAction->setIcon(QIcon(":/images/icon_trackface.png"));
     trackFaceAction->setShortcut(tr("Ctrl+T"));
-    trackFaceAction->setStatusTip(tr("Track a face by color between frames"));
+    trackFaceAction->setStatusTip(tr("Track a face between frames, by color or by feature points (Settings > Tracker)"));
     trackFaceAction->setCheckable(true);
     connect(trackFaceAction, SIGNAL(triggered()), this, SLOT(trackFace()));
 
@@ -299,10 +557,86 @@ void CameraWindow::createActions() {
     cascadeFileAction->setStatusTip(tr("Set a cascade file for detecting faces"));    
     connect(cascadeFileAction, SIGNAL(triggered()), this, SLOT(setCascadeFile()));
 
+    skinFilterAction = new QAction(tr("Skin Color &Prefilter"), this);
+    skinFilterAction->setStatusTip(tr("Only search faces in the skin colored regions (uses the CamShift calibration)"));
+    skinFilterAction->setCheckable(true);
+    connect(skinFilterAction, SIGNAL(triggered()), this, SLOT(setSkinFilter()));
+
+    // SubMenu Latency Budget
+    budgetGroup = new QActionGroup(this);
+    QList<int> budgets = QList<int>() << 0 << 10 << 15 << 25 << 40;
+    foreach(int budget, budgets) {
+        QAction *action = new QAction(budget ? tr("%1 ms per frame").arg(budget) : tr("&Off (default parameters)"), budgetGroup);
+        action->setCheckable(true);
+        action->setChecked(budget == 0);
+        action->setData(budget);
+    }
+    connect(budgetGroup, SIGNAL(triggered(QAction *)), this, SLOT(setDetectBudget(QAction *)));
+
     camshiftDialogAction = new QAction(tr("CamShift Calibration"), this);
     camshiftDialogAction->setStatusTip(tr("Change the vMin and sMin variables for CamShift"));
     connect(camshiftDialogAction, SIGNAL(triggered()), mCamShiftDialog, SLOT(show()));
 
+    qosAction = new QAction(tr("&Drop Late Work (QoS)"), this);
+    qosAction->setStatusTip(tr("Skip detection, overlay and recording for the frames that are already late"));
+    qosAction->setCheckable(true);
+    connect(qosAction, SIGNAL(triggered()), this, SLOT(setQoS()));
+
+    idleThrottleAction = new QAction(tr("&Idle Throttling"), this);
+    idleThrottleAction->setStatusTip(tr("Lower the capture rate and skip repaints while there are no faces and nothing moves"));
+    idleThrottleAction->setCheckable(true);
+    connect(idleThrottleAction, SIGNAL(triggered()), this, SLOT(setIdleThrottle()));
+
+    exportAction = new QAction(tr("&Share Frames (Shared Memory)"), this);
+    exportAction->setStatusTip(tr("Publish the frames and the detected faces for other local processes"));
+    exportAction->setCheckable(true);
+    connect(exportAction, SIGNAL(triggered()), this, SLOT(setExport()));
+
+    camshiftPredictionAction = new QAction(tr("CamShift Motion &Prediction"), this);
+    camshiftPredictionAction->setStatusTip(tr("Start each CamShift search where a motion model predicts the face"));
+    camshiftPredictionAction->setCheckable(true);
+    camshiftPredictionAction->setChecked(true);
+    connect(camshiftPredictionAction, SIGNAL(triggered()), this, SLOT(setCamShiftPrediction()));
+
+    // SubMenu Tracker
+    trackerGroup = new QActionGroup(this);
+    QAction *camshiftTrackerAction = new QAction(tr("&CamShift (face color)"), trackerGroup);
+    camshiftTrackerAction->setData(FramePipeline::CamShiftTracker);
+    QAction *flowTrackerAction = new QAction(tr("&Optical Flow (face features)"), trackerGroup);
+    flowTrackerAction->setData(FramePipeline::OpticalFlowTracker);
+    foreach(QAction *action, trackerGroup->actions()) {
+        action->setCheckable(true);
+        action->setChecked(action == camshiftTrackerAction);
+    }
+    connect(trackerGroup, SIGNAL(triggered(QAction *)), this, SLOT(setTracker()));
+
+    // SubMenu CamShift Mode
+    camshiftModeGroup = new QActionGroup(this);
+    QAction *referenceModeAction = new QAction(tr("&Reference (OpenCV back projection)"), camshiftModeGroup);
+    referenceModeAction->setData(CamShift::ReferenceMode);
+    QAction *fusedModeAction = new QAction(tr("&Fused kernel"), camshiftModeGroup);
+    fusedModeAction->setData(CamShift::FusedMode);
+    QAction *lookupModeAction = new QAction(tr("&Lookup table (no HSV conversion)"), camshiftModeGroup);
+    lookupModeAction->setData(CamShift::LookupMode);
+    foreach(QAction *action, camshiftModeGroup->actions()) {
+        action->setCheckable(true);
+        action->setChecked(action == fusedModeAction);
+    }
+    connect(camshiftModeGroup, SIGNAL(triggered(QAction *)), this, SLOT(setCamShiftMode(QAction *)));
+
+    // SubMenu Cameras
+    QSettings settings("Kronen Software", "Qt + OpenCV");
+    int cameras = qMax(1, settings.value("Cameras", 1).toInt());
+    camerasGroup = new QActionGroup(this);
+    QList<int> counts = QList<int>() << 1 << 2 << 4 << 8;
+    foreach(int count, counts) {
+        QAction *action = new QAction(tr("%n camera(s)", "", count), camerasGroup);
+        action->setCheckable(true);
+        action->setChecked(count == cameras);
+        action->setData(count);
+    }
+    connect(camerasGroup, SIGNAL(triggered(QAction *)), this, SLOT(setCameras(QAction *)));
+
     flipHorizontallyAction = new QAction(tr("Flip &Horizontally"), this);
     flipHorizontallyAction->setStatusTip(tr("Flip the image horizontally"));
     flipHorizontallyAction->setCheckable(true);
@@ -25,11 +25,13 @@
 #include <QtGui/QToolBar>
 #include <QtGui/QStatusBar>
 #include <QtGui/QAction>
+#include <QtGui/QActionGroup>
 #include <QtGui/QLabel>
 #include <QtGui/QCloseEvent>
 
 #include "opencvwidget.h"
 #include "camshiftdialog.h"
+#include "startup.h"
 
 class CameraWindow : public QMainWindow {
     Q_OBJECT
@@ -43,14 +45,30 @@ class CameraWindow : public QMainWindow {
         void createToolBar();
         void createStatusBar();
         void readSettings();
+        void createCameraWidgets(int cameras);
+        void startupStep();
 
     private slots:
+        void cameraReady();
+        void cascadeLoaded();
         void writeSettings();
         void saveScreenshot();
+        void saveBurst();
         void writeVideo();
+        void writeRaw();
+        void setAutoRecord();
         void detectFaces();
         void trackFace();
         void setCascadeFile();
+        void setSkinFilter();
+        void setDetectBudget(QAction *action);
+        void setQoS();
+        void setIdleThrottle();
+        void setExport();
+        void setCameras(QAction *action);
+        void setTracker();
+        void setCamShiftMode(QAction *action);
+        void setCamShiftPrediction();
         void createCamShiftDialog();
         void flipHorizontally();
         void flipVertically();
@@ -61,25 +79,48 @@ class CameraWindow : public QMainWindow {
         virtual void closeEvent(QCloseEvent *event);
 
     private:
-        OpenCVWidget *cvWidget;
+        OpenCVWidget *cvWidget;             // First camera, the settings are read from it
+        QList<OpenCVWidget *> cvWidgets;
         CamShiftDialog *mCamShiftDialog;
 
+        // Startup, the cameras and the cascade are loaded on the background
+        CascadeLoader *mCascadeLoader;
+        int mCamerasPending;
+        bool mCamerasReady;
+        bool mSettingsRead;
+
         QMenu *fileMenu;
         QMenu *settingsMenu;
         QMenu *faceDetectMenu;
         QMenu *flagsMenu;
+        QMenu *budgetMenu;
+        QMenu *camerasMenu;
+        QMenu *camshiftModeMenu;
+        QMenu *trackerMenu;
         QToolBar *toolBar;
         QLabel *statusLabel;
 
         QAction *quitAction;
         QAction *screenshotAction;
+        QAction *burstAction;
         QAction *videoAction;
+        QAction *rawAction;
+        QAction *autoRecordAction;
         QAction *detectFacesAction;
         QAction *trackFaceAction;
 
         // Settings Menu
         QAction *cascadeFileAction;
+        QAction *skinFilterAction;
+        QActionGroup *budgetGroup;
         QAction *camshiftDialogAction;
+        QAction *qosAction;
+        QAction *idleThrottleAction;
+        QAction *exportAction;
+        QAction *camshiftPredictionAction;
+        QActionGroup *camerasGroup;
+        QActionGroup *camshiftModeGroup;
+        QActionGroup *trackerGroup;
         QAction *flipHorizontallyAction;
         QAction *flipVerticallyAction;
 
@@ -18,6 +18,13 @@
 
 #include "camshift.h"
 
+#include <float.h>
+#include <math.h>
+
+#include <QVarLengthArray>
+
+#include "cpudispatch.h"
+
 CamShift::CamShift(CvSize size) {
     float *ranges = mRangesArray;
     mHistBins = 30;
@@ -27,91 +34,389 @@ CamShift::CamShift(CvSize size) {
     mVMax = 256;
     mSMin = 50;
     mFrames = 0;
-    mHSVImg  = cvCreateImage(size, 8, 3);
-    mHueImg  = cvCreateImage(size, 8, 1);
-    mMask    = cvCreateImage(size, 8, 1);
+    mIterations = 0;
+    mTrackTime = 0;
+    mMode = FusedMode;
+    mPrediction = true;
+    mPrevFaceRect = cvRect(0, 0, 0, 0);
+    mBgrLut = new uchar[32 * 32 * 32];
+    mBgrLutDirty = true;
     mProbImg = cvCreateImage(size, 8, 1);
 
     mHist = cvCreateHist(1, &mHistBins, CV_HIST_ARRAY, &ranges, 1);
+
+    // Constant velocity model: state (cx, cy, w, h, vx, vy, vw, vh), measurement (cx, cy, w, h)
+    mKalman = cvCreateKalman(8, 4, 0);
+    cvSetIdentity(mKalman->transition_matrix, cvRealScalar(1));
+    for(int i = 0; i < 4; i++) cvmSet(mKalman->transition_matrix, i, i + 4, 1);
+    cvSetIdentity(mKalman->measurement_matrix, cvRealScalar(1));
+    cvSetIdentity(mKalman->process_noise_cov, cvRealScalar(1e-2));
+    cvSetIdentity(mKalman->measurement_noise_cov, cvRealScalar(1));
 }
 
 CamShift::~CamShift() {
-    cvReleaseImage(&mHSVImg);
-    cvReleaseImage(&mHueImg);
-    cvReleaseImage(&mMask);
     cvReleaseImage(&mProbImg);
 
     cvReleaseHist(&mHist);
+    cvReleaseKalman(&mKalman);
+    delete [] mBgrLut;
 }
 
-void CamShift::startTracking(IplImage *cvImage, CvRect cvRect) {
+void CamShift::startTracking(FrameImages *images, CvRect cvRect) {
     float maxVal = 0.f;
 
-    // Get mHSVImg and mHueImg
-    updateHueImage(cvImage);
+    // Get the hue and the mask of the face rect
+    IplImage *hueImg = images->hue(cvRect);
+    IplImage *mask = images->mask(cvRect, mVMin, mVMax, mSMin);
 
-    // Calc the histogram of the defined rect in mHueImg
-    cvSetImageROI(mHueImg, cvRect);
-    cvSetImageROI(mMask, cvRect);
-    cvCalcHist(&mHueImg, mHist, 0, mMask);  // cvCalcHist(image, histogram, accumulate, mask)
+    // Calc the histogram of the defined rect in hueImg
+    cvSetImageROI(hueImg, cvRect);
+    cvSetImageROI(mask, cvRect);
+    cvCalcHist(&hueImg, mHist, 0, mask);    // cvCalcHist(image, histogram, accumulate, mask)
 
     // We get the MaxValue in the histogram and scale for that value
     cvGetMinMaxHistValue(mHist, 0, &maxVal, 0, 0);  // cvGetMinMaxHistValue(hist, minVal, maxVal, minIndex, maxIndex)
     cvConvertScale(mHist->bins, mHist->bins, maxVal ? (255.0 / maxVal) : 0, 0); // cvConvertScale(src, dst, scale, shift)
-    cvResetImageROI(mHueImg);
-    cvResetImageROI(mMask);
+    cvResetImageROI(hueImg);
+    cvResetImageROI(mask);
+    updateHueLut();
+    mBgrLutDirty = true;
 
     // Store the previous face location
     mPrevFaceRect = cvRect;
+    mFaceBox.center = cvPoint2D32f(cvRect.x + cvRect.width * 0.5f, cvRect.y + cvRect.height * 0.5f);
+    mFaceBox.size = cvSize2D32f(cvRect.width, cvRect.height);
+    mFaceBox.angle = 0;
+
+    resetMotionModel(cvRect);
+    mFrames = 0;
 }
 
-CvBox2D CamShift::trackFace(IplImage *cvImage) {
-    CvConnectedComp components;
+// The motion model starts again on the rect, without velocity
+void CamShift::resetMotionModel(CvRect rect) {
+    cvZero(mKalman->state_post);
+    cvmSet(mKalman->state_post, 0, 0, rect.x + rect.width * 0.5);
+    cvmSet(mKalman->state_post, 1, 0, rect.y + rect.height * 0.5);
+    cvmSet(mKalman->state_post, 2, 0, rect.width);
+    cvmSet(mKalman->state_post, 3, 0, rect.height);
+    cvSetIdentity(mKalman->error_cov_post, cvRealScalar(1));
+}
 
-    // Create a new hue image
-    updateHueImage(cvImage);
+CvBox2D CamShift::trackFace(FrameImages *images) {
+    double timeElapsed = (double)cvGetTickCount();
+    CvConnectedComp components;
+    IplImage *cvImage = images->frame();
+    CvSize size = cvGetSize(cvImage);
+    int iterations;
 
-    // Create a probability image based on the face histogram (precalculated on startTracking())
-    cvCalcBackProject(&mHueImg, mProbImg, mHist);
-    cvAnd(mProbImg, mMask, mProbImg, 0);    // cvAnd(src1, src2, dst, mask)
-    CvSize size = cvGetSize(mProbImg);
+    // Start the search where the motion model predicts the face, or where it was on the previous frame
+    CvRect window = mPrevFaceRect;
+    if(mPrediction) {
+        const CvMat *prediction = cvKalmanPredict(mKalman, 0);
+        float width = MAX(8.f, prediction->data.fl[2]);
+        float height = MAX(8.f, prediction->data.fl[3]);
+        window = cvRect(cvRound(prediction->data.fl[0] - width / 2), cvRound(prediction->data.fl[1] - height / 2),
+                        cvRound(width), cvRound(height));
+    }
 
     // Check for face out of scope
-    if(mPrevFaceRect.x < 0) mPrevFaceRect.x = 0;
-    if(mPrevFaceRect.x >= size.width) mPrevFaceRect.x = size.width - 1;
-    if(mPrevFaceRect.y < 0) mPrevFaceRect.y = 0;
-    if(mPrevFaceRect.y >= size.height) mPrevFaceRect.y = size.height - 1;
-    if(mPrevFaceRect.x + mPrevFaceRect.width > size.width) mPrevFaceRect.width = size.width - mPrevFaceRect.x;
-    if(mPrevFaceRect.y + mPrevFaceRect.height > size.height) mPrevFaceRect.height = size.height - mPrevFaceRect.y;
+    if(window.x < 0) window.x = 0;
+    if(window.x >= size.width) window.x = size.width - 1;
+    if(window.y < 0) window.y = 0;
+    if(window.y >= size.height) window.y = size.height - 1;
+    if(window.x + window.width > size.width) window.width = size.width - window.x;
+    if(window.y + window.height > size.height) window.height = size.height - window.y;
+
+    // With the prediction the face stays close to the window, so we only process the region around it
+    CvRect region = cvRect(0, 0, size.width, size.height);
+    if(mPrediction) {
+        int marginX = window.width + 10;    // 10 is the tolerance cvCamShift adds for the orientation
+        int marginY = window.height + 10;
+        region.x = MAX(0, window.x - marginX);
+        region.y = MAX(0, window.y - marginY);
+        region.width = MIN(size.width, window.x + window.width + marginX) - region.x;
+        region.height = MIN(size.height, window.y + window.height + marginY) - region.y;
+    }
+
+    // Without any face probability in the window we keep the previous location (see below)
+    components.rect = window;
+    components.area = 0;
+    CvBox2D faceBox = mFaceBox;
+    faceBox.angle = -faceBox.angle;
 
     // Use CamShift to find the center of the new face probability
-    cvCamShift(mProbImg, mPrevFaceRect, cvTermCriteria(CV_TERMCRIT_EPS | CV_TERMCRIT_ITER, 10, 1),
-                &components, &mFaceBox);
+    CvTermCriteria criteria = cvTermCriteria(CV_TERMCRIT_EPS | CV_TERMCRIT_ITER, 10, 1);
+
+    if(mMode == FusedMode) {
+        // The fused kernel only needs the HSV image of the region
+        iterations = fusedCamShift(images->hsv(region), region, window, criteria, &components, &faceBox);
+    } else if(mMode == LookupMode) {
+        // The lookup kernel reads the BGR image directly
+        if(mBgrLutDirty) updateBgrLut();
+        iterations = fusedCamShift(cvImage, region, window, criteria, &components, &faceBox);
+    } else {
+        IplImage *hueImg = images->hue(region);
+        IplImage *mask = images->mask(region, mVMin, mVMax, mSMin);
+
+        cvSetImageROI(hueImg, region);
+        cvSetImageROI(mask, region);
+        cvSetImageROI(mProbImg, region);
+
+        // Create a probability image based on the face histogram (precalculated on startTracking())
+        cvCalcBackProject(&hueImg, mProbImg, mHist);
+        cvAnd(mProbImg, mask, mProbImg, 0);     // cvAnd(src1, src2, dst, mask)
+
+        // cvCamShift works on region coordinates
+        window.x -= region.x;
+        window.y -= region.y;
+        iterations = cvCamShift(mProbImg, window, criteria, &components, &faceBox);
+        if(iterations >= 0) {
+            components.rect.x += region.x;
+            components.rect.y += region.y;
+            faceBox.center.x += region.x;
+            faceBox.center.y += region.y;
+        }
+
+        cvResetImageROI(hueImg);
+        cvResetImageROI(mask);
+        cvResetImageROI(mProbImg);
+    }
+
+    // Update the motion model with the new face location. A frame without face probability (the face is
+    // hidden or out of the window) keeps the last location and stops the model there: coasting on the
+    // velocity would move the window away from where the face is likely to come back
+    if(iterations < 0 || components.area <= 0) {
+        components.rect = mPrevFaceRect;
+        if(mPrediction) resetMotionModel(mPrevFaceRect);
+    } else if(mPrediction) {
+        float measurement[] = { components.rect.x + components.rect.width * 0.5f,
+                                components.rect.y + components.rect.height * 0.5f,
+                                (float)components.rect.width, (float)components.rect.height };
+        CvMat measurementMat = cvMat(4, 1, CV_32FC1, measurement);
+        cvKalmanCorrect(mKalman, &measurementMat);
+    }
 
     // Update face location and angle
     mPrevFaceRect = components.rect;
+    mFaceBox = faceBox;
     mFaceBox.angle = -mFaceBox.angle;
 
+    // Statistics
+    timeElapsed = ((double)cvGetTickCount() - timeElapsed)/((double)cvGetTickFrequency()*1000);
+    mIterations = mFrames ? 0.9 * mIterations + 0.1 * MAX(0, iterations) : MAX(0, iterations);
+    mTrackTime = mFrames ? 0.9 * mTrackTime + 0.1 * timeElapsed : timeElapsed;
+    mFrames++;
+
     return mFaceBox;
 }
 
-void CamShift::updateHueImage(const IplImage *cvImage) {
-    // Convert to HSV color model
-    cvCvtColor(cvImage, mHSVImg, CV_BGR2HSV);
+// Back projection value of each hue, the same value cvCalcBackProject writes on mProbImg
+void CamShift::updateHueLut() {
+    double binWidth = (mRangesArray[1] - mRangesArray[0]) / mHistBins;
+
+    for(int hue = 0; hue < 256; hue++) {
+        if(hue >= mRangesArray[0] && hue < mRangesArray[1]) {
+            int bin = cvFloor((hue - mRangesArray[0]) / binWidth);
+            int value = cvRound(cvQueryHistValue_1D(mHist, bin));
+            mHueLut[hue] = (uchar)MAX(0, MIN(255, value));
+        } else mHueLut[hue] = 0;
+    }
+}
+
+// Quantized BGR to face probability table: the HSV conversion, the vMin/sMin mask and the histogram
+// lookup of the center of each cell, so tracking needs a single table lookup per pixel
+void CamShift::updateBgrLut() {
+    IplImage *bgr = cvCreateImage(cvSize(32 * 32 * 32, 1), 8, 3);
+    IplImage *hsv = cvCreateImage(cvSize(32 * 32 * 32, 1), 8, 3);
+    uchar *color = (uchar *)bgr->imageData;
+
+    for(int index = 0; index < 32 * 32 * 32; index++, color += 3) {
+        color[0] = (uchar)(((index >> 10) & 31) << 3 | 4);
+        color[1] = (uchar)(((index >> 5) & 31) << 3 | 4);
+        color[2] = (uchar)((index & 31) << 3 | 4);
+    }
+    cvCvtColor(bgr, hsv, CV_BGR2HSV);
 
-    // Mask out-of-range values
-    cvInRangeS(mHSVImg, cvScalar(0, mSMin, MIN(mVMin, mVMax), 0), cvScalar(180, 256, MAX(mVMin, mVMax), 0), mMask);
+    int vLow = MIN(mVMin, mVMax);
+    int vHigh = MAX(mVMin, mVMax);
+    const uchar *pixel = (const uchar *)hsv->imageData;
+    for(int index = 0; index < 32 * 32 * 32; index++, pixel += 3) {
+        if(pixel[1] < mSMin || pixel[2] < vLow || pixel[2] >= vHigh) mBgrLut[index] = 0;
+            else mBgrLut[index] = mHueLut[pixel[0]];
+    }
 
-    // Extract the hue channel
-    cvSplit(mHSVImg, mHueImg, 0, 0, 0);
+    cvReleaseImage(&bgr);
+    cvReleaseImage(&hsv);
+    mBgrLutDirty = false;
+}
+
+// Face probability of an HSV pixel, the pixel test is the same as FrameImages::mask()
+struct HSVProbability {
+    const uchar *hueLut;
+    int sMin, vLow, vHigh;
+
+    inline int operator()(const uchar *pixel) const {
+        if(pixel[1] < sMin || pixel[2] < vLow || pixel[2] >= vHigh) return 0;
+        return hueLut[pixel[0]];
+    }
+};
+
+// Face probability of a BGR pixel from the quantized table
+struct BGRProbability {
+    const uchar *bgrLut;
+
+    inline int operator()(const uchar *pixel) const {
+        return bgrLut[(pixel[0] >> 3) << 10 | (pixel[1] >> 3) << 5 | (pixel[2] >> 3)];
+    }
+};
+
+// Fused back projection + mask + moments over a window of a 3 channel image. The probabilities of a row
+// are looked up first, then its moments are summed by the kernel of the CPU (see CpuDispatch)
+template<class Probability>
+void CamShift::accumulateMoments(const IplImage *image, CvRect window, const Probability &probability,
+                                 bool central, WindowMoments *moments) {
+    double m00 = 0, m10 = 0, m01 = 0, m20 = 0, m11 = 0, m02 = 0;
+    RowMomentsKernel rowMoments = CpuDispatch::kernels().rowMoments;
+    QVarLengthArray<uchar, 2048> row(window.width);
+
+    for(int y = 0; y < window.height; y++) {
+        const uchar *pixel = (const uchar *)(image->imageData + (window.y + y) * image->widthStep) + window.x * 3;
+        for(int x = 0; x < window.width; x++, pixel += 3) row[x] = (uchar)probability(pixel);
+
+        // Row sums are integers, so they are exact
+        RowMoments sums;
+        rowMoments(row.constData(), window.width, &sums);
+
+        m00 += sums.sum0;
+        m10 += sums.sum1;
+        m01 += (double)sums.sum0 * y;
+        if(central) {
+            m20 += (double)sums.sum2;
+            m11 += (double)sums.sum1 * y;
+            m02 += (double)sums.sum0 * y * y;
+        }
+    }
+
+    moments->m00 = m00;
+    moments->m10 = m10;
+    moments->m01 = m01;
+    moments->mu20 = moments->mu11 = moments->mu02 = 0;
+
+    if(central && m00 > DBL_EPSILON) {
+        double xc = m10 / m00, yc = m01 / m00;
+        moments->mu20 = m20 - m10 * xc;
+        moments->mu11 = m11 - m10 * yc;
+        moments->mu02 = m02 - m01 * yc;
+    }
+}
+
+void CamShift::windowMoments(const IplImage *image, CvRect window, bool central, WindowMoments *moments) const {
+    if(mMode == LookupMode) {
+        BGRProbability probability;
+        probability.bgrLut = mBgrLut;
+        accumulateMoments(image, window, probability, central, moments);
+    } else {
+        HSVProbability probability;
+        probability.hueLut = mHueLut;
+        probability.sMin = mSMin;
+        probability.vLow = MIN(mVMin, mVMax);
+        probability.vHigh = MAX(mVMin, mVMax);
+        accumulateMoments(image, window, probability, central, moments);
+    }
+}
+
+// Same steps as cvMeanShift + cvCamShift, but the face probability is calculated on the fly from the image
+// (HSV or BGR depending on the mode) and the windows don't leave bounds.
+// Returns the number of mean shift iterations, or -1 if there is no face probability
+int CamShift::fusedCamShift(const IplImage *image, CvRect bounds, CvRect window, CvTermCriteria criteria,
+                            CvConnectedComp *comp, CvBox2D *box) const {
+    const int tolerance = 10;
+    int left = bounds.x, top = bounds.y;
+    int right = bounds.x + bounds.width, bottom = bounds.y + bounds.height;
+    int eps = cvRound(criteria.epsilon * criteria.epsilon);
+    WindowMoments moments;
+    CvRect rect = window;
+    int iterations;
+
+    if(rect.width <= 0 || rect.height <= 0) return -1;
+
+    // Mean shift
+    for(iterations = 0; iterations < criteria.max_iter; iterations++) {
+        windowMoments(image, rect, false, &moments);
+        if(moments.m00 < DBL_EPSILON) break;
+
+        int dx = cvRound(moments.m10 / moments.m00 - window.width * 0.5);
+        int dy = cvRound(moments.m01 / moments.m00 - window.height * 0.5);
+        int nx = MAX(left, MIN(right - rect.width, rect.x + dx));
+        int ny = MAX(top, MIN(bottom - rect.height, rect.y + dy));
+
+        dx = nx - rect.x;
+        dy = ny - rect.y;
+        rect.x = nx;
+        rect.y = ny;
+
+        if(dx * dx + dy * dy < eps) break;
+    }
+
+    // Orientation and size from the second order moments of an enlarged window
+    CvRect search = rect;
+    search.x = MAX(left, search.x - tolerance);
+    search.y = MAX(top, search.y - tolerance);
+    search.width = MIN(right - search.x, search.width + 2 * tolerance);
+    search.height = MIN(bottom - search.y, search.height + 2 * tolerance);
+
+    windowMoments(image, search, true, &moments);
+    if(moments.m00 < DBL_EPSILON) return -1;
+
+    double invM00 = 1. / moments.m00;
+    int xc = cvRound(moments.m10 * invM00 + search.x);
+    int yc = cvRound(moments.m01 * invM00 + search.y);
+    double a = moments.mu20 * invM00, b = moments.mu11 * invM00, c = moments.mu02 * invM00;
+    double square = sqrt(4 * b * b + (a - c) * (a - c));
+    double theta = atan2(2 * b, a - c + square);
+    double cs = cos(theta), sn = sin(theta);
+    double rotateA = cs * cs * moments.mu20 + 2 * cs * sn * moments.mu11 + sn * sn * moments.mu02;
+    double rotateC = sn * sn * moments.mu20 - 2 * cs * sn * moments.mu11 + cs * cs * moments.mu02;
+    double length = sqrt(rotateA * invM00) * 4;
+    double breadth = sqrt(rotateC * invM00) * 4;
+
+    if(length < breadth) {
+        double t;
+        CV_SWAP(length, breadth, t);
+        CV_SWAP(cs, sn, t);
+        theta = CV_PI * 0.5 - theta;
+    }
+
+    int t0 = MAX(cvRound(fabs(length * cs)), cvRound(fabs(breadth * sn))) + 2;
+    comp->rect.width = MIN(t0, (right - xc) * 2);
+    t0 = MAX(cvRound(fabs(length * sn)), cvRound(fabs(breadth * cs))) + 2;
+    comp->rect.height = MIN(t0, (bottom - yc) * 2);
+    comp->rect.x = MAX(left, xc - comp->rect.width / 2);
+    comp->rect.y = MAX(top, yc - comp->rect.height / 2);
+    comp->rect.width = MIN(right - comp->rect.x, comp->rect.width);
+    comp->rect.height = MIN(bottom - comp->rect.y, comp->rect.height);
+    comp->area = (float)moments.m00;
+
+    box->size.height = (float)length;
+    box->size.width = (float)breadth;
+    box->angle = (float)(theta * 180. / CV_PI);
+    box->center = cvPoint2D32f(comp->rect.x + comp->rect.width * 0.5f, comp->rect.y + comp->rect.height * 0.5f);
+
+    return iterations;
 }
 
 void CamShift::setVMin(int vMin) {
-    if(mVMin != vMin) mVMin = vMin;
+    if(mVMin != vMin) {
+        mVMin = vMin;
+        mBgrLutDirty = true;
+    }
 }
 
 void CamShift::setSMin(int sMin) {
-    if(mSMin != sMin) mSMin = sMin;
+    if(mSMin != sMin) {
+        mSMin = sMin;
+        mBgrLutDirty = true;
+    }
 }
 
 int CamShift::vMin() const {
@@ -121,3 +426,32 @@ int CamShift::vMin() const {
 int CamShift::sMin() const {
     return mSMin;
 }
+
+void CamShift::setMode(Mode mode) {
+    mMode = mode;
+}
+
+CamShift::Mode CamShift::mode() const {
+    return mMode;
+}
+
+// Predict the search window with the motion model (constant velocity Kalman filter). The model isn't
+// updated while it's off, so switching it on restarts it on the current location
+void CamShift::setPrediction(bool prediction) {
+    if(prediction && !mPrediction) resetMotionModel(mPrevFaceRect);
+    mPrediction = prediction;
+}
+
+bool CamShift::isPrediction() const {
+    return mPrediction;
+}
+
+// Smoothed mean shift iterations per frame
+double CamShift::iterations() const {
+    return mIterations;
+}
+
+// Smoothed milliseconds per trackFace()
+double CamShift::trackTime() const {
+    return mTrackTime;
+}
@@ -21,16 +21,24 @@
 
 #include "cv.h"
 
+#include "frameimages.h"
+
 class CamShift {
     public:
+        // How the face probability of each pixel is calculated:
+        // ReferenceMode: cvCalcBackProject + cvAnd + cvCamShift over full-frame images
+        // FusedMode: back projection, mask and moments in one pass over the search window of the HSV image
+        // LookupMode: like FusedMode, but the probability comes from a quantized BGR table, no HSV conversion
+        enum Mode { ReferenceMode, FusedMode, LookupMode };
+
         CamShift(CvSize size);
         ~CamShift();
 
     public:
         // Main Control functions
         void releaseTracker();
-        void startTracking(IplImage *cvImage, CvRect cvRect);
-        CvBox2D trackFace(IplImage *cvImage);
+        void startTracking(FrameImages *images, CvRect cvRect);
+        CvBox2D trackFace(FrameImages *images);
 
         // Parameter settings
         void setVMin(int vmin);
@@ -38,8 +46,32 @@ class CamShift {
         int vMin() const;
         int sMin() const;
 
+        void setMode(Mode mode);
+        Mode mode() const;
+        void setPrediction(bool prediction);
+        bool isPrediction() const;
+
+        // Statistics
+        double iterations() const;
+        double trackTime() const;
+
     private:
-        void updateHueImage(const IplImage *cvImage);
+        // Raw and central moments of the face probability inside a window (window coordinates)
+        struct WindowMoments {
+            double m00, m10, m01;
+            double mu20, mu11, mu02;
+        };
+
+        void updateHueLut();
+        void updateBgrLut();
+        void resetMotionModel(CvRect rect);
+        void windowMoments(const IplImage *image, CvRect window, bool central, WindowMoments *moments) const;
+        int fusedCamShift(const IplImage *image, CvRect bounds, CvRect window, CvTermCriteria criteria,
+                          CvConnectedComp *comp, CvBox2D *box) const;
+
+        template<class Probability>
+        static void accumulateMoments(const IplImage *image, CvRect window, const Probability &probability,
+                                      bool central, WindowMoments *moments);
 
     private:
         int mHistBins;          // Number of Histogram Bins
@@ -47,15 +79,20 @@ class CamShift {
         int mVMin, mVMax;
         int mSMin;              // Limits for calculating HUE
 
-        IplImage *mHSVImg;     // Image converted to HSV color mode
-        IplImage *mHueImg;     // Hue channel of the HSV image
-        IplImage *mMask;       // Image for masking pixels
         IplImage *mProbImg;    // Face Probability Estimates for each pixel
         CvHistogram *mHist;    // Histogram of HUE in the original image
+        uchar mHueLut[256];    // Back projection value for each hue (from mHist)
+        uchar *mBgrLut;        // Face probability for each BGR color quantized to 5 bits per channel
+        bool mBgrLutDirty;     // mBgrLut must be rebuilt (histogram, vMin or sMin changed)
+        Mode mMode;
+        CvKalman *mKalman;     // Motion model of the window center and size
+        bool mPrediction;
 
         CvRect mPrevFaceRect;    // Location of Face in Previous Frame
         CvBox2D mFaceBox;        // Current Face-Location Estimate
         int mFrames;
+        double mIterations;      // Smoothed iterations per frame
+        double mTrackTime;       // Smoothed milliseconds per frame
 };
 
 #endif // CAMSHIFT_H
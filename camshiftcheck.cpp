@@ -0,0 +1,111 @@
+/*  
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+ 
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include "camshiftcheck.h"
+
+#include <math.h>
+
+#include "framesource.h"
+#include "frameimages.h"
+
+static const char *modeNames[] = { "reference", "fused", "lookup" };
+
+CamShiftCheck::CamShiftCheck() {
+    mFrames = 0;
+    mCenter = mSize = mAngle = 0;
+    for(int mode = 0; mode < 3; mode++) {
+        mMax[mode].center = mMax[mode].size = mMax[mode].angle = 0;
+        mMax[mode].failedFrames = 0;
+    }
+}
+
+bool CamShiftCheck::run(int frames, double center, double size, double angle) {
+    mLines.clear();
+    mFrames = 0;
+    mCenter = center;
+    mSize = size;
+    mAngle = angle;
+
+    SyntheticSource source;
+    FrameImages images;
+    IplImage *frame = source.queryFrame();
+    CamShift *trackers[3];
+
+    // The same start for all the modes, on the face the source has drawn
+    images.setFrame(frame);
+    for(int mode = 0; mode < 3; mode++) {
+        trackers[mode] = new CamShift(cvGetSize(frame));
+        trackers[mode]->setMode(CamShift::Mode(mode));
+        trackers[mode]->startTracking(&images, source.faceRect());
+        mMax[mode].center = mMax[mode].size = mMax[mode].angle = 0;
+        mMax[mode].failedFrames = 0;
+    }
+
+    for(int i = 1; i < frames; i++) {
+        frame = source.queryFrame();
+        images.setFrame(frame);
+
+        CvBox2D boxes[3];
+        for(int mode = 0; mode < 3; mode++) boxes[mode] = trackers[mode]->trackFace(&images);
+        const CvBox2D &reference = boxes[CamShift::ReferenceMode];
+
+        for(int mode = CamShift::FusedMode; mode <= CamShift::LookupMode; mode++) {
+            const CvBox2D &box = boxes[mode];
+            double dx = box.center.x - reference.center.x, dy = box.center.y - reference.center.y;
+            double centerDifference = sqrt(dx * dx + dy * dy);
+            double sizeDifference = MAX(fabs(box.size.width - reference.size.width) / MAX(1.0f, reference.size.width),
+                                        fabs(box.size.height - reference.size.height) / MAX(1.0f, reference.size.height));
+
+            // The angle is the same modulo 180 degrees
+            double angleDifference = fmod(fabs(box.angle - reference.angle), 180.0);
+            angleDifference = MIN(angleDifference, 180.0 - angleDifference);
+
+            Difference &max = mMax[mode];
+            max.center = MAX(max.center, centerDifference);
+            max.size = MAX(max.size, sizeDifference);
+            max.angle = MAX(max.angle, angleDifference);
+
+            if(centerDifference > center || sizeDifference > size || angleDifference > angle) {
+                if(max.failedFrames++ < 4)
+                    mLines << QString("%1: frame %2 differs, center %3 px, size %4%, angle %5 degrees").arg(modeNames[mode])
+                              .arg(i).arg(centerDifference, 0, 'f', 1).arg(sizeDifference * 100, 0, 'f', 1)
+                              .arg(angleDifference, 0, 'f', 1);
+            }
+        }
+        mFrames++;
+    }
+
+    for(int mode = 0; mode < 3; mode++) delete trackers[mode];
+
+    return mMax[CamShift::FusedMode].failedFrames == 0 && mMax[CamShift::LookupMode].failedFrames == 0;
+}
+
+QString CamShiftCheck::report() const {
+    QStringList lines = mLines;
+
+    for(int mode = CamShift::FusedMode; mode <= CamShift::LookupMode; mode++) {
+        const Difference &max = mMax[mode];
+        lines << QString("%1: %2 of %3 frames over the tolerance, at most %4 px, %5%, %6 degrees from the reference")
+                 .arg(modeNames[mode]).arg(max.failedFrames).arg(mFrames).arg(max.center, 0, 'f', 1)
+                 .arg(max.size * 100, 0, 'f', 1).arg(max.angle, 0, 'f', 1);
+    }
+    lines << QString("Tolerance: %1 px on the center, %2% on the sides, %3 degrees on the angle").arg(mCenter)
+             .arg(mSize * 100).arg(mAngle);
+
+    return lines.join("\n");
+}
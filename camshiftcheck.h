@@ -0,0 +1,51 @@
+/*  
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+ 
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef CAMSHIFTCHECK_H
+#define CAMSHIFTCHECK_H
+
+#include <QString>
+#include <QStringList>
+
+#include "camshift.h"
+
+// Tracks the face of the synthetic source with the three CamShift modes at once and compares the boxes of
+// the fused and lookup modes with the reference one on every frame. The check fails if the center moves
+// more than 'center' pixels, a side changes more than 'size' (a fraction of the reference side) or the
+// angle more than 'angle' degrees on any frame.
+class CamShiftCheck {
+    public:
+        CamShiftCheck();
+
+    public:
+        bool run(int frames, double center = 3, double size = 0.1, double angle = 5);
+        QString report() const;
+
+    private:
+        struct Difference {
+            double center, size, angle;
+            int failedFrames;
+        };
+
+        QStringList mLines;
+        Difference mMax[3];             // Largest differences of each mode to the reference
+        int mFrames;
+        double mCenter, mSize, mAngle;  // Tolerances
+};
+
+#endif // CAMSHIFTCHECK_H
@@ -0,0 +1,245 @@
+/*  
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+ 
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include "capturethread.h"
+
+#include <QMutexLocker>
+#include <math.h>
+
+#include "frameqos.h"
+
+CaptureThread::CaptureThread(int cameraIndex) : QThread() {
+    mCameraIndex = cameraIndex;
+    mSource = 0;
+    mPool = 0;
+    mSize = cvSize(0, 0);
+    mLuma = false;
+    mOpenTime = 0;
+    mSequence = 0;
+    mOpen = false;
+    mStop = false;
+    mPeriod = 1000/16;
+    mRestart = false;
+    mFlipH = mFlipV = false;
+    mColorNeeded = true;
+    mDropped = 0;
+    mDumping = false;
+    mDumpPending = 0;
+    mDumpStart = 0;
+    mDump = 0;
+    mDumpOrigin = 0;
+}
+
+CaptureThread::~CaptureThread() {
+    stop();
+    wait();
+
+    // All the frames must be back before the pool goes
+    mLatest.release();
+    if(mPool) delete mPool;
+    if(mDumpPending) delete mDumpPending;
+}
+
+void CaptureThread::stop() {
+    QMutexLocker locker(&mLock);
+    mStop = true;
+    mWake.wakeAll();
+}
+
+void CaptureThread::run() {
+    double start = FrameQoS::now();
+
+    // The first frame (the slowest one with some drivers) gives the size and tells if there is luma
+    mSource = new CameraSource(mCameraIndex);
+    IplImage *first = mSource->isOpen() && mSource->grabFrame() ? mSource->retrieveFrame() : 0;
+    if(first) {
+        mSize = cvGetSize(first);
+        mLuma = mSource->retrieveLuma() != 0;
+        // A frame being filled, the latest one, one on the GUI and two on the workers (pending and running)
+        mPool = new FramePool(mSize, 8, 3, 6, mLuma);
+    }
+    mOpenTime = FrameQoS::now() - start;
+
+    {
+        QMutexLocker locker(&mLock);
+        mOpen = first != 0;
+    }
+    emit opened(first != 0);
+
+    QMutexLocker locker(&mLock);
+    double last = FrameQoS::now() - mPeriod;
+    while(first && !mStop) {
+        // Wait for the tick, setPeriod() and stop() wake the thread before. A new period applies at once:
+        // the tick is calculated again, and a shorter period can't put it in the past
+        double now = FrameQoS::now();
+        if(mRestart) {
+            last = qMax(last, now - mPeriod);
+            mRestart = false;
+        }
+        double tick = last + mPeriod;
+        if(now < tick) {
+            mWake.wait(&mLock, (unsigned long)ceil(tick - now));
+            continue;
+        }
+
+        // A late tick isn't made up with a burst of frames, the schedule starts again from now
+        last = now - tick < mPeriod ? tick : now;
+
+        locker.unlock();
+        Frame frame = grab();
+        locker.relock();
+
+        if(!frame.isNull()) {
+            bool notify = mLatest.isNull();
+            if(!notify) mDropped++;
+            mLatest = frame;
+            if(notify) emit frameReady();
+        }
+    }
+    locker.unlock();
+
+    if(mDump) delete mDump;
+    mDump = 0;
+    delete mSource;
+    mSource = 0;
+}
+
+// Grabs a frame and copies it to a pooled buffer, top-left and with the flips. Null if the camera
+// doesn't give it or all the buffers are in use. The frame is stamped when the driver delivers it: a camera
+// slower than the ticks blocks the grab, and that wait isn't processing lateness
+Frame CaptureThread::grab() {
+    bool flipH, flipV, color;
+    FrameDumpWriter *finished = 0;
+    {
+        QMutexLocker locker(&mLock);
+        flipH = mFlipH;
+        flipV = mFlipV;
+
+        // A dump started or stopped: the thread takes the new writer and closes the old one
+        if(mDumpPending || (!mDumping && mDump)) {
+            finished = mDump;
+            mDump = mDumpPending;
+            mDumpOrigin = mDumpStart;
+            mDumpPending = 0;
+        }
+        color = mDump || mColorNeeded;
+    }
+    if(finished) delete finished;
+
+    if(!mSource->grabFrame()) return Frame();
+
+    FrameInfo info;
+    info.sequence = mSequence++;
+    info.timestamp = FrameQoS::now();
+
+    IplImage *luma = mLuma ? mSource->retrieveLuma() : 0;
+    IplImage *image = color || !luma ? mSource->retrieveFrame() : 0;
+    if(!luma && !image) return Frame();
+
+    if(mDump && image) mDump->write(image, qint64((info.timestamp - mDumpOrigin) * 1000));
+
+    Frame frame = mPool->acquire();
+    if(frame.isNull()) {
+        QMutexLocker locker(&mLock);
+        mDropped++;
+        return frame;
+    }
+
+    info.flipH = flipH;
+    info.flipV = flipV;
+    frame.fill(image, luma, info);
+    return frame;
+}
+
+bool CaptureThread::isOpen() const {
+    QMutexLocker locker(&mLock);
+    return mOpen;
+}
+
+CvSize CaptureThread::frameSize() const {
+    return mSize;
+}
+
+bool CaptureThread::hasLuma() const {
+    return mLuma;
+}
+
+double CaptureThread::openTime() const {
+    return mOpenTime;
+}
+
+Frame CaptureThread::takeFrame() {
+    QMutexLocker locker(&mLock);
+    Frame frame = mLatest;
+    mLatest.release();
+    return frame;
+}
+
+int CaptureThread::droppedFrames() const {
+    QMutexLocker locker(&mLock);
+    return mDropped;
+}
+
+void CaptureThread::setPeriod(double ms) {
+    QMutexLocker locker(&mLock);
+    mPeriod = ms;
+    mRestart = true;
+    mWake.wakeAll();
+}
+
+void CaptureThread::setFlip(bool flipH, bool flipV) {
+    QMutexLocker locker(&mLock);
+    mFlipH = flipH;
+    mFlipV = flipV;
+}
+
+void CaptureThread::setColorNeeded(bool needed) {
+    QMutexLocker locker(&mLock);
+    mColorNeeded = needed;
+}
+
+// The file is opened here and handed to the thread with its next frame, the frames are written there
+bool CaptureThread::startDump(const QString &filename) {
+    if(!isOpen() || isDumping()) return false;
+
+    FrameDumpWriter *dump = new FrameDumpWriter();
+    if(!dump->open(filename, mSize, FrameDumpHeader::Bgr24)) {
+        delete dump;
+        return false;
+    }
+
+    QMutexLocker locker(&mLock);
+    if(mDumpPending) delete mDumpPending;
+    mDumpPending = dump;
+    mDumpStart = FrameQoS::now();
+    mDumping = true;
+    return true;
+}
+
+// The thread closes the file with its next frame
+void CaptureThread::stopDump() {
+    QMutexLocker locker(&mLock);
+    if(mDumpPending) delete mDumpPending;
+    mDumpPending = 0;
+    mDumping = false;
+}
+
+bool CaptureThread::isDumping() const {
+    QMutexLocker locker(&mLock);
+    return mDumping;
+}
@@ -0,0 +1,102 @@
+/*
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef CAPTURETHREAD_H
+#define CAPTURETHREAD_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QString>
+
+#include "cv.h"
+
+#include "framesource.h"
+#include "frame.h"
+#include "framedump.h"
+
+// Owns a camera for its whole life: the capture is opened, grabbed and released on this thread, because
+// the highgui backends are bound to the thread that opens them (the VFW capture window, the COM apartment
+// of DirectShow). The frames are copied (flipped) to pooled buffers and handed to the GUI thread: only the
+// latest one is kept, so a busy GUI drops frames instead of queuing them.
+class CaptureThread : public QThread {
+    Q_OBJECT
+
+    signals:
+        void opened(bool ok);       // The first frame was grabbed, or the camera failed
+        void frameReady();          // takeFrame() has a frame
+
+    public:
+        CaptureThread(int cameraIndex);
+        ~CaptureThread();           // Stops the capture and waits for the camera to be released
+
+    public:
+        // Valid after opened()
+        bool isOpen() const;
+        CvSize frameSize() const;
+        bool hasLuma() const;       // The source delivers the luma plane and the frames keep it
+        double openTime() const;
+
+        // The latest frame, null if there isn't a new one
+        Frame takeFrame();
+        int droppedFrames() const;  // Replaced before the GUI took them
+
+        void setPeriod(double ms);
+        void setFlip(bool flipH, bool flipV);
+        void setColorNeeded(bool needed);  // With luma, the BGR image is only converted if needed
+
+        // Raw frames as the camera gives them (not flipped), written on this thread
+        bool startDump(const QString &filename);
+        void stopDump();
+        bool isDumping() const;
+
+    protected:
+        void run();
+
+    private:
+        Frame grab();
+        void stop();
+
+    private:
+        int mCameraIndex;
+        FrameSource *mSource;       // Only used by the thread
+        FramePool *mPool;
+        CvSize mSize;
+        bool mLuma;
+        double mOpenTime;
+        qint64 mSequence;
+
+        mutable QMutex mLock;
+        QWaitCondition mWake;       // Period changes and stop
+        bool mOpen;
+        bool mStop;
+        double mPeriod;
+        bool mRestart;              // The period changed
+        bool mFlipH, mFlipV;
+        bool mColorNeeded;
+        Frame mLatest;
+        int mDropped;
+        bool mDumping;
+        FrameDumpWriter *mDumpPending;  // Opened by startDump(), not taken by the thread yet
+        double mDumpStart;
+
+        FrameDumpWriter *mDump;     // Only used by the thread, written without any lock
+        double mDumpOrigin;
+};
+
+#endif // CAPTURETHREAD_H
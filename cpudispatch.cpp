@@ -0,0 +1,135 @@
+/*
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include "cpudispatch.h"
+
+#if defined(_MSC_VER) && defined(VISION_SSE2)
+#include <intrin.h>
+#elif defined(__GNUC__) && defined(VISION_SSE2)
+#include <cpuid.h>
+#endif
+
+static const char *levelNames[CpuDispatch::LevelCount] = { "scalar", "sse2", "avx2" };
+
+// Variants of each level, the unsupported ones fall back to the one below
+static const VisionKernels levelKernels[CpuDispatch::LevelCount] = {
+    { rowMomentsScalar },
+#ifdef VISION_SSE2
+    { rowMomentsSSE2 },
+#else
+    { rowMomentsScalar },
+#endif
+#ifdef VISION_AVX2
+    { rowMomentsAVX2 }
+#else
+    { rowMomentsScalar }
+#endif
+};
+
+CpuDispatch::Level CpuDispatch::mSupported = CpuDispatch::Scalar;
+CpuDispatch::Level CpuDispatch::mLevel = CpuDispatch::Scalar;
+
+#ifdef VISION_SSE2
+static void cpuid(unsigned int leaf, unsigned int regs[4]) {
+#ifdef _MSC_VER
+    __cpuidex((int *)regs, leaf, 0);
+#else
+    __cpuid_count(leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+#ifdef VISION_AVX2
+// Register state the OS saves on context switches (XCR0)
+static unsigned int xgetbv() {
+#ifdef _MSC_VER
+    return (unsigned int)_xgetbv(0);
+#else
+    unsigned int eax, edx;
+    __asm__ volatile(".byte 0x0f, 0x01, 0xd0" : "=a"(eax), "=d"(edx) : "c"(0));
+    return eax;
+#endif
+}
+#endif
+#endif
+
+CpuDispatch::Level CpuDispatch::detect() {
+    Level level = Scalar;
+
+#ifdef VISION_SSE2
+    unsigned int regs[4];
+    cpuid(0, regs);
+    unsigned int maxLeaf = regs[0];
+
+    cpuid(1, regs);
+    if(regs[3] & (1 << 26)) level = SSE2;
+
+#ifdef VISION_AVX2
+    // AVX2 needs the OS to save the YMM registers too
+    bool osAvx = (regs[2] & (1 << 27)) && (regs[2] & (1 << 28)) && (xgetbv() & 6) == 6;
+    if(level == SSE2 && osAvx && maxLeaf >= 7) {
+        cpuid(7, regs);
+        if(regs[1] & (1 << 5)) level = AVX2;
+    }
+#else
+    Q_UNUSED(maxLeaf);
+#endif
+#endif
+
+    return level;
+}
+
+// Called once at startup, before the workers run any kernel
+void CpuDispatch::install() {
+    mSupported = mLevel = detect();
+}
+
+bool CpuDispatch::setLevel(Level level) {
+    if(level < Scalar || level > mSupported) return false;
+    mLevel = level;
+    return true;
+}
+
+CpuDispatch::Level CpuDispatch::level() {
+    return mLevel;
+}
+
+CpuDispatch::Level CpuDispatch::supportedLevel() {
+    return mSupported;
+}
+
+const VisionKernels &CpuDispatch::kernels() {
+    return levelKernels[mLevel];
+}
+
+const VisionKernels *CpuDispatch::kernels(Level level) {
+    return (level >= Scalar && level <= mSupported) ? &levelKernels[level] : 0;
+}
+
+QString CpuDispatch::levelName(Level level) {
+    return levelNames[level];
+}
+
+bool CpuDispatch::parseLevel(const QString &name, Level *level) {
+    for(int i = 0; i < LevelCount; i++) {
+        if(name.compare(levelNames[i], Qt::CaseInsensitive) == 0) {
+            *level = Level(i);
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,56 @@
+/*
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef CPUDISPATCH_H
+#define CPUDISPATCH_H
+
+#include <QString>
+
+#include "visionkernels.h"
+
+// The kernels bound to one instruction set level
+struct VisionKernels {
+    RowMomentsKernel rowMoments;
+};
+
+// Detects the CPU features once (install(), at startup) and binds each kernel to the best implementation
+// the CPU and the compiler support. A lower level can be forced (OpenCV --cpu=scalar|sse2|avx2).
+class CpuDispatch {
+    public:
+        enum Level { Scalar, SSE2, AVX2, LevelCount };
+
+        static void install();
+        static bool setLevel(Level level);      // False if the CPU or the build doesn't support it
+        static Level level();
+        static Level supportedLevel();          // The best one of this CPU and build
+
+        static const VisionKernels &kernels();
+        static const VisionKernels *kernels(Level level);   // 0 if not supported
+
+        static QString levelName(Level level);
+        static bool parseLevel(const QString &name, Level *level);
+
+    private:
+        static Level detect();
+
+    private:
+        static Level mSupported;
+        static Level mLevel;
+};
+
+#endif // CPUDISPATCH_H
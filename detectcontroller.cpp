@@ -0,0 +1,87 @@
+/*
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include "detectcontroller.h"
+
+DetectController::DetectController() {
+    mFastest = DetectParams(2.0, 1.35, 4, 64);
+    mFinest = DetectParams(1.0, 1.1, 4, 40);
+    mBudget = 0;
+    mAverage = 0;
+    mLevel = 0.5;
+    mSamples = 0;
+}
+
+void DetectController::setBudget(double ms) {
+    mBudget = ms;
+    mLevel = 0.5;
+    mSamples = 0;
+
+    if(mBudget > 0) applyLevel();
+        else mParams = DetectParams();
+}
+
+double DetectController::budget() const {
+    return mBudget;
+}
+
+void DetectController::setBounds(const DetectParams &fastest, const DetectParams &finest) {
+    mFastest = fastest;
+    mFinest = finest;
+    if(mBudget > 0) applyLevel();
+}
+
+bool DetectController::update(double elapsedMs) {
+    // Exponential moving average, so a single slow frame doesn't make us jump
+    mAverage = mSamples ? 0.8 * mAverage + 0.2 * elapsedMs : elapsedMs;
+    mSamples++;
+
+    if(mBudget <= 0 || mSamples < 4) return false;
+
+    double previous = mLevel;
+
+    // Go down fast when we are over budget and go up slowly when there is headroom
+    if(mAverage > mBudget) mLevel -= 0.02 + 0.1 * MIN(1.0, mAverage / mBudget - 1.0);
+        else if(mAverage < 0.75 * mBudget) mLevel += 0.02;
+
+    mLevel = MAX(0.0, MIN(1.0, mLevel));
+    if(mLevel == previous) return false;
+
+    applyLevel();
+    return true;
+}
+
+// Interpolate each parameter between its bounds
+void DetectController::applyLevel() {
+    mParams.downscale = mFastest.downscale + (mFinest.downscale - mFastest.downscale) * mLevel;
+    mParams.scaleFactor = mFastest.scaleFactor + (mFinest.scaleFactor - mFastest.scaleFactor) * mLevel;
+    mParams.minNeighbors = cvRound(mFastest.minNeighbors + (mFinest.minNeighbors - mFastest.minNeighbors) * mLevel);
+    mParams.minSize = cvRound(mFastest.minSize + (mFinest.minSize - mFastest.minSize) * mLevel);
+}
+
+DetectParams DetectController::params() const {
+    return mParams;
+}
+
+double DetectController::averageTime() const {
+    return mAverage;
+}
+
+double DetectController::level() const {
+    return mLevel;
+}
@@ -0,0 +1,56 @@
+/*
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef DETECTCONTROLLER_H
+#define DETECTCONTROLLER_H
+
+#include "facedetect.h"
+
+// Adapts the face detection parameters to a per-frame latency budget.
+// It moves a quality level between the fastest and the finest parameters using the measured detection times,
+// so weak hardware keeps the frame rate and strong hardware spends the spare time on accuracy.
+class DetectController {
+    public:
+        DetectController();
+
+    public:
+        void setBudget(double ms);          // 0 disables the controller (default parameters)
+        double budget() const;
+        void setBounds(const DetectParams &fastest, const DetectParams &finest);
+
+        // Feed the time of the last detection, returns true if the parameters changed
+        bool update(double elapsedMs);
+
+        DetectParams params() const;
+        double averageTime() const;
+        double level() const;
+
+    private:
+        void applyLevel();
+
+    private:
+        DetectParams mParams;       // Current parameters
+        DetectParams mFastest;      // Bounds of the parameters
+        DetectParams mFinest;
+        double mBudget;             // Target milliseconds per detection
+        double mAverage;            // Smoothed detection time
+        double mLevel;              // 0 = fastest, 1 = finest
+        int mSamples;
+};
+
+#endif // DETECTCONTROLLER_H
@@ -0,0 +1,202 @@
+/*
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include "eventrecorder.h"
+#include "snapshotwriter.h"
+
+#include <QMutexLocker>
+
+EventRecorder::EventRecorder(int buffers) : QThread() {
+    mPreRoll = new PreRollBuffer();
+    mPreRollSeconds = mPreRoll->duration();
+    mState = Idle;
+    mTimeout = 5;
+    mLastFace = 0;
+    mBufferCount = buffers;
+    mDropped = 0;
+    mQuit = false;
+
+    start(QThread::LowPriority);
+}
+
+// Finishes the video being written before stopping
+EventRecorder::~EventRecorder() {
+    stop();
+    {
+        QMutexLocker locker(&mMutex);
+        mQuit = true;
+        mJobAvailable.wakeOne();
+    }
+    wait();
+
+    foreach(IplImage *buffer, mBuffers) cvReleaseImage(&buffer);
+    delete mPreRoll;
+}
+
+bool EventRecorder::addFrame(const IplImage *frame, double time, bool faces) {
+    if(faces) mLastFace = time;
+
+    if(mState == Idle) {
+        // A frame that finds no free buffer is left out of the pre-roll
+        queueFrame(Job::PreRoll, frame, time);
+        if(!faces) return false;
+
+        return startRecording(frame);
+    }
+
+    queueFrame(Job::Frame, frame, time);
+
+    if(time - mLastFace > mTimeout * 1000) {
+        stop();
+        return true;
+    }
+    return false;
+}
+
+// A new video that starts with the pre-roll frames, the thread writes them before the frames of the event
+bool EventRecorder::startRecording(const IplImage *frame) {
+    mFileName = SnapshotWriter::nextFileName("NextVideo", "webcamVid%1.avi", 1);
+
+    // Same settings as FramePipeline::startRecording()
+    Job job;
+    job.type = Job::Start;
+    job.writer = cvCreateVideoWriter(mFileName.toUtf8(), CV_FOURCC('D','I','V','X'), 8, cvGetSize(frame));
+    if(!job.writer) return false;
+
+    QMutexLocker locker(&mMutex);
+    mDropped = 0;
+    mJobs.enqueue(job);
+    mJobAvailable.wakeOne();
+
+    mState = Recording;
+    return true;
+}
+
+// The frame belongs to the caller, it's copied to a free buffer without allocating. Returns false if there
+// wasn't one, the frames of an event count as dropped
+bool EventRecorder::queueFrame(Job::Type type, const IplImage *frame, double time) {
+    QMutexLocker locker(&mMutex);
+
+    // The frame buffers, allocated with the first frame
+    if(mBuffers.isEmpty()) {
+        for(int i = 0; i < mBufferCount; i++) {
+            mBuffers.append(cvCreateImage(cvGetSize(frame), frame->depth, frame->nChannels));
+            mFreeBuffers.append(i);
+        }
+    }
+
+    const IplImage *first = mBuffers.at(0);
+    if(mFreeBuffers.isEmpty() || frame->width != first->width || frame->height != first->height
+       || frame->nChannels != first->nChannels) {
+        if(type == Job::Frame) mDropped++;
+        return false;
+    }
+
+    Job job;
+    job.type = type;
+    job.writer = 0;
+    job.buffer = mFreeBuffers.takeFirst();
+    job.time = time;
+    cvCopy(frame, mBuffers[job.buffer], 0);
+    mBuffers[job.buffer]->origin = frame->origin;
+
+    mJobs.enqueue(job);
+    mJobAvailable.wakeOne();
+    return true;
+}
+
+// Closes the video of the event, the pre-roll starts again empty
+void EventRecorder::stop() {
+    QMutexLocker locker(&mMutex);
+    Job job;
+    job.type = Job::Stop;
+    job.writer = 0;
+    mJobs.enqueue(job);
+    mJobAvailable.wakeOne();
+
+    mState = Idle;
+}
+
+void EventRecorder::run() {
+    CvVideoWriter *writer = 0;
+    QMutexLocker locker(&mMutex);
+
+    forever {
+        while(mJobs.isEmpty() && !mQuit) mJobAvailable.wait(&mMutex);
+        if(mJobs.isEmpty()) break;
+
+        // Work without holding the lock, addFrame() doesn't touch a buffer until it's free again
+        Job job = mJobs.dequeue();
+        double preRoll = mPreRollSeconds;
+        locker.unlock();
+
+        switch(job.type) {
+            case Job::PreRoll:
+                mPreRoll->setDuration(preRoll);
+                mPreRoll->addFrame(mBuffers.at(job.buffer), job.time);
+                break;
+            case Job::Start:
+                writer = job.writer;
+                mPreRoll->writeTo(writer);
+                break;
+            case Job::Frame:
+                cvWriteFrame(writer, mBuffers.at(job.buffer));
+                break;
+            case Job::Stop:
+                if(writer) cvReleaseVideoWriter(&writer);
+                mPreRoll->clear();
+                break;
+        }
+
+        locker.relock();
+        if(job.type == Job::PreRoll || job.type == Job::Frame) mFreeBuffers.append(job.buffer);
+    }
+
+    if(writer) cvReleaseVideoWriter(&writer);
+}
+
+EventRecorder::State EventRecorder::state() const {
+    return mState;
+}
+
+QString EventRecorder::fileName() const {
+    return mFileName;
+}
+
+int EventRecorder::dropped() const {
+    QMutexLocker locker(&mMutex);
+    return mDropped;
+}
+
+void EventRecorder::setPreRoll(double seconds) {
+    QMutexLocker locker(&mMutex);
+    mPreRollSeconds = seconds;
+}
+
+double EventRecorder::preRoll() const {
+    QMutexLocker locker(&mMutex);
+    return mPreRollSeconds;
+}
+
+void EventRecorder::setTimeout(double seconds) {
+    mTimeout = seconds;
+}
+
+double EventRecorder::timeout() const {
+    return mTimeout;
+}
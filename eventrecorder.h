@@ -0,0 +1,94 @@
+/*
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef EVENTRECORDER_H
+#define EVENTRECORDER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QVector>
+#include <QQueue>
+#include <QString>
+
+#include "cv.h"
+#include "highgui.h"
+
+#include "prerollbuffer.h"
+
+// Records only when there are faces. While idle the frames go to the pre-roll buffer, a face
+// starts a new video with it and the recording continues until no face has been seen for the timeout.
+// addFrame() only copies the frames into pooled buffers (dropped if all are waiting), the recorder's own
+// thread does the rest: it compresses the pre-roll frames and, on an event, decodes them one at a time
+// into the video and writes the frames of the event after them.
+class EventRecorder : public QThread {
+    public:
+        enum State { Idle, Recording };
+
+        EventRecorder(int buffers = 12);
+        ~EventRecorder();
+
+    public:
+        // Returns true if the state changed with this frame
+        bool addFrame(const IplImage *frame, double time, bool faces);
+        void stop();
+
+        State state() const;
+        QString fileName() const;
+        int dropped() const;        // Frames of the last event that found no free buffer
+
+        void setPreRoll(double seconds);
+        double preRoll() const;
+        void setTimeout(double seconds);
+        double timeout() const;
+
+    protected:
+        void run();
+
+    private:
+        struct Job {
+            enum Type { PreRoll, Start, Frame, Stop };
+
+            Type type;
+            CvVideoWriter *writer;  // Start
+            int buffer;             // PreRoll and Frame
+            double time;            // PreRoll
+        };
+
+        bool startRecording(const IplImage *frame);
+        bool queueFrame(Job::Type type, const IplImage *frame, double time);
+
+    private:
+        PreRollBuffer *mPreRoll;    // Frames before an event, only used by the thread
+        double mPreRollSeconds;
+        State mState;
+        QString mFileName;
+        double mTimeout;            // Seconds without faces to stop
+        double mLastFace;           // Time of the last frame with faces
+
+        mutable QMutex mMutex;
+        QWaitCondition mJobAvailable;
+        QQueue<Job> mJobs;
+        QVector<IplImage *> mBuffers;
+        QList<int> mFreeBuffers;
+        int mBufferCount;
+        int mDropped;
+        bool mQuit;
+};
+
+#endif // EVENTRECORDER_H
@@ -18,26 +18,136 @@
 
 #include "facedetect.h"
 #include <QDebug>
+#include <QHash>
+#include <QMutexLocker>
 
-FaceDetect::FaceDetect() {
-    mCascadeFile = "";
+#include <string.h>
+
+// Models loaded in the process, by file name
+static QHash<QString, CascadeModel *> loadedModels;
+static QMutex loadedModelsLock;
+
+CascadeModel::CascadeModel() {
     mCascade = 0;
-    mFlags = 0;
+    mRefs = 0;
+}
+
+CascadeModel::~CascadeModel() {
+    if(mCascade) cvReleaseHaarClassifierCascade(&mCascade);
+}
+
+CascadeModel *CascadeModel::acquire(const QString &cascadeFile) {
+    CascadeModel *model;
+    {
+        QMutexLocker locker(&loadedModelsLock);
+        if((model = loadedModels.value(cascadeFile))) {
+            model->mRefs++;
+            return model;
+        }
+    }
+
+    // Loaded without the lock (a big cascade takes a while). If another thread loaded it meanwhile we use that one
+    CvHaarClassifierCascade *cascade = (CvHaarClassifierCascade *) cvLoad(cascadeFile.toUtf8());
+    if(!cascade) return 0;
+
+    QMutexLocker locker(&loadedModelsLock);
+    if((model = loadedModels.value(cascadeFile))) {
+        cvReleaseHaarClassifierCascade(&cascade);
+    } else {
+        model = new CascadeModel();
+        model->mCascadeFile = cascadeFile;
+        model->mCascade = cascade;
+        loadedModels.insert(cascadeFile, model);
+    }
+
+    model->mRefs++;
+    return model;
+}
+
+void CascadeModel::release(CascadeModel *model) {
+    QMutexLocker locker(&loadedModelsLock);
+
+    if(--model->mRefs == 0) {
+        loadedModels.remove(model->mCascadeFile);
+        delete model;
+    }
+}
+
+QString CascadeModel::cascadeFile() const {
+    return mCascadeFile;
+}
+
+const CvHaarClassifierCascade *CascadeModel::cascade() const {
+    return mCascade;
+}
+
+
+DetectContext::DetectContext(CascadeModel *model) {
+    mModel = model;
+
+    // The stage classifiers are shared (read only), the hidden cascade will be this context's one
+    mCascade = *model->cascade();
+    mCascade.hid_cascade = 0;
 
     // Storage for the rectangles detected
     mStorage = cvCreateMemStorage(0);
 }
 
+DetectContext::~DetectContext() {
+    // The hidden cascade is released by OpenCV, which also frees its IPP stages on IPP builds: a header with
+    // no stages of its own takes it over, so nothing of the model goes with it
+    if(mCascade.hid_cascade) {
+        CvHaarClassifierCascade *owner = (CvHaarClassifierCascade *)cvAlloc(sizeof(CvHaarClassifierCascade));
+        memset(owner, 0, sizeof(CvHaarClassifierCascade));
+        owner->hid_cascade = mCascade.hid_cascade;
+        cvReleaseHaarClassifierCascade(&owner);
+        mCascade.hid_cascade = 0;
+    }
+    cvReleaseMemStorage(&mStorage);
+}
+
+CascadeModel *DetectContext::model() const {
+    return mModel;
+}
+
+CvSeq *DetectContext::detect(const IplImage *image, double scaleFactor, int minNeighbors, int flags, CvSize minSize) {
+    cvClearMemStorage(mStorage);
+    return cvHaarDetectObjects(image, &mCascade, mStorage, scaleFactor, minNeighbors, flags, minSize);
+}
+
+DetectParams::DetectParams(double downscale, double scaleFactor, int minNeighbors, int minSize) {
+    this->downscale = downscale;
+    this->scaleFactor = scaleFactor;
+    this->minNeighbors = minNeighbors;
+    this->minSize = minSize;
+}
+
+FaceDetect::FaceDetect() {
+    mCascadeFile = "";
+    mModel = 0;
+    mContext = 0;
+    mFlags = 0;
+    mLastDetectTime = 0;
+    mUseSkinFilter = false;
+
+    mSkinFilter = new SkinFilter();
+}
+
 FaceDetect::~FaceDetect() {
-    if(mCascade) cvReleaseHaarClassifierCascade(&mCascade);
+    if(mContext) delete mContext;
+    if(mModel) CascadeModel::release(mModel);
+    delete mSkinFilter;
 }
 
 
-// Load a new classifier cascade, we unload first the previous classifier
+// Load a new classifier cascade (or share it if it's already loaded), we unload first the previous classifier
 void FaceDetect::setCascadeFile(QString cascadeFile) {
     mCascadeFile = cascadeFile;
-    if(mCascade) cvReleaseHaarClassifierCascade(&mCascade);
-    mCascade = (CvHaarClassifierCascade *) cvLoad(mCascadeFile.toUtf8());
+    if(mContext) delete mContext;
+    if(mModel) CascadeModel::release(mModel);
+
+    mModel = CascadeModel::acquire(mCascadeFile);
+    mContext = mModel ? new DetectContext(mModel) : 0;
 }
 
 QString FaceDetect::cascadeFile() const {
@@ -67,39 +177,80 @@ void FaceDetect::setFlags(int flags) {
     mFlags = flags;
 }
 
-QVector<QRect> FaceDetect::detectFaces(IplImage *cvImage) {
+void FaceDetect::setSkinFilter(bool enabled) {
+    mUseSkinFilter = enabled;
+}
+
+void FaceDetect::setParams(const DetectParams &params) {
+    mParams = params;
+}
+
+DetectParams FaceDetect::params() const {
+    return mParams;
+}
+
+double FaceDetect::lastDetectTime() const {
+    return mLastDetectTime;
+}
+
+bool FaceDetect::isSkinFilterEnabled() const {
+    return mUseSkinFilter;
+}
+
+SkinFilter *FaceDetect::skinFilter() {
+    return mSkinFilter;
+}
+
+// The equalized small image comes from the frame images, so it's shared with the other detections of the frame
+QVector<QRect> FaceDetect::detectFaces(FrameImages *images) {
     QVector<QRect> listRect;
     CvRect *rect = NULL;
-    double scale = 1.3;
+    double scale = mParams.downscale;
+    CvSize minSize = cvSize(mParams.minSize, mParams.minSize);
+    double timeElapsed = (double)cvGetTickCount();
 
-    // Create a gray scale image (1 channel) to turn it into a small image that we send to cvHaarDetectObjects to process
-    IplImage *grayImage = cvCreateImage(cvSize(cvImage->width, cvImage->height), cvImage->depth, CV_8UC1);
-    IplImage *smallImage = cvCreateImage(cvSize(cvRound(cvImage->width/scale), cvRound(cvImage->height/scale)),
-                                         cvImage->depth, CV_8UC1);
+    // Gray scale image (1 channel), reduced and equalized (normaliza brillo, incrementa contraste)
+    IplImage *smallImage = images->equalized(scale);
 
-    cvCvtColor(cvImage, grayImage, CV_BGR2GRAY);
-    cvResize(grayImage, smallImage);
-    cvEqualizeHist(smallImage, smallImage);         // Grays smoothing (normaliza brillo, incrementa contraste)
-    cvClearMemStorage(mStorage);
+    if(mContext) {                                  // It isn't necessary in this context, because mContext exist if we reach this point
+        // Without the prefilter we search the whole image, with it only the skin regions (in small image coordinates)
+        QVector<CvRect> regions;
+        if(mUseSkinFilter && images->frame()) {
+            foreach(CvRect region, mSkinFilter->candidateRegions(images)) {
+                int x1 = MAX(0, cvFloor(region.x / scale));
+                int y1 = MAX(0, cvFloor(region.y / scale));
+                int x2 = MIN(smallImage->width, cvCeil((region.x + region.width) / scale));
+                int y2 = MIN(smallImage->height, cvCeil((region.y + region.height) / scale));
+                if(x2 - x1 >= minSize.width && y2 - y1 >= minSize.height) regions.append(cvRect(x1, y1, x2 - x1, y2 - y1));
+            }
+        } else regions.append(cvRect(0, 0, smallImage->width, smallImage->height));
 
-    if(mCascade) {                                  // It isn't necessary in this context, because mCascade exist if we reach this point
-        double timeElapsed = (double)cvGetTickCount();
-        CvSeq *faces = cvHaarDetectObjects(smallImage, mCascade, mStorage, 1.2, 4, mFlags, cvSize(64, 64));
-        timeElapsed = (double)cvGetTickCount() - timeElapsed;
+        foreach(CvRect region, regions) {
+            cvSetImageROI(smallImage, region);
+            CvSeq *faces = mContext->detect(smallImage, mParams.scaleFactor, mParams.minNeighbors, mFlags, minSize);
+            cvResetImageROI(smallImage);
 
-        //qDebug() << QString("detection time = %1").arg(timeElapsed/((double)cvGetTickFrequency()*1000));
+            for(int i = 0; i < faces->total; i++) {
+                rect = (CvRect*)cvGetSeqElem(faces, i);
+                listRect.append(QRect((rect->x + region.x) * scale, (rect->y + region.y) * scale,
+                                      rect->width * scale, rect->height * scale));
+            }
+        }
 
-        for(int i = 0; i < faces->total; i++) {
-            rect = (CvRect*)cvGetSeqElem(faces, i);
-            listRect.append(QRect(rect->x * scale, rect->y * scale, rect->width * scale, rect->height * scale));
+        // Each region returns its own biggest object, we only keep the biggest one of them
+        if((mFlags & CV_HAAR_FIND_BIGGEST_OBJECT) && listRect.size() > 1) {
+            QRect biggest = listRect.at(0);
+            foreach(QRect face, listRect)
+                if(face.width() * face.height() > biggest.width() * biggest.height()) biggest = face;
+            listRect.clear();
+            listRect.append(biggest);
         }
     }
 
-    cvReleaseImage(&grayImage);
-    cvReleaseImage(&smallImage);
+    // The whole call is measured (conversions included), it's what the latency budget has to pay for
+    timeElapsed = (double)cvGetTickCount() - timeElapsed;
+    mLastDetectTime = timeElapsed/((double)cvGetTickFrequency()*1000);
+    //qDebug() << QString("detection time = %1").arg(mLastDetectTime);
 
     return listRect;
 }
-
-
-
@@ -25,6 +25,58 @@
 
 #include "cv.h"
 
+#include "skinfilter.h"
+#include "frameimages.h"
+
+// Parameters of cvHaarDetectObjects and of the image reduction done before calling it
+struct DetectParams {
+    DetectParams(double downscale = 1.3, double scaleFactor = 1.2, int minNeighbors = 4, int minSize = 64);
+
+    double downscale;       // The frame is reduced by this factor before detecting
+    double scaleFactor;     // Scale step of the search window
+    int minNeighbors;       // Minimum neighbor rectangles to accept a face
+    int minSize;            // Minimum face size (in reduced image pixels)
+};
+
+// A cascade loaded once and shared by all the FaceDetect instances (and threads) that use the same file.
+// The model is never modified after loading: the detections run on the DetectContext copies.
+class CascadeModel {
+    public:
+        static CascadeModel *acquire(const QString &cascadeFile);
+        static void release(CascadeModel *model);
+
+    public:
+        QString cascadeFile() const;
+        const CvHaarClassifierCascade *cascade() const;
+
+    private:
+        CascadeModel();
+        ~CascadeModel();
+
+    private:
+        QString mCascadeFile;
+        CvHaarClassifierCascade *mCascade;
+        int mRefs;                  // Protected by the lock of the loaded models
+};
+
+// What a thread needs to detect against a shared model: the scratch storage and its own copy of the cascade
+// header. OpenCV builds the hidden (optimized) cascade on the first detection and rescales it on every call,
+// so each context has its own one, built from the shared stages. A context is used by one thread at a time.
+class DetectContext {
+    public:
+        DetectContext(CascadeModel *model);
+        ~DetectContext();
+
+    public:
+        CascadeModel *model() const;
+        CvSeq *detect(const IplImage *image, double scaleFactor, int minNeighbors, int flags, CvSize minSize);
+
+    private:
+        CascadeModel *mModel;
+        CvHaarClassifierCascade mCascade;   // Shallow copy of the model's cascade
+        CvMemStorage *mStorage;
+};
+
 class FaceDetect {
 public:
     FaceDetect();
@@ -33,14 +85,26 @@ public:
     void setCascadeFile(QString cascadeFile);
     QString cascadeFile() const;
     void setFlags(int flags);
-    QVector<QRect> detectFaces(IplImage *cvImage);
+    void setParams(const DetectParams &params);
+    DetectParams params() const;
+    QVector<QRect> detectFaces(FrameImages *images);
+    double lastDetectTime() const;
+
+    // Skin color prefilter, only the skin regions are searched by the cascade
+    void setSkinFilter(bool enabled);
+    bool isSkinFilterEnabled() const;
+    SkinFilter *skinFilter();
 
 private:
-    CvHaarClassifierCascade *mCascade;
-    CvMemStorage *mStorage;
+    CascadeModel *mModel;
+    DetectContext *mContext;
+    SkinFilter *mSkinFilter;
 
     QString mCascadeFile;    
     int mFlags;
+    DetectParams mParams;
+    double mLastDetectTime;     // Milliseconds spent in the last detectFaces()
+    bool mUseSkinFilter;
 };
 
 #endif // FACEDETECT_H
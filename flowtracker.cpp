@@ -0,0 +1,243 @@
+/*
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include "flowtracker.h"
+
+#include <algorithm>
+#include <math.h>
+
+FlowTracker::FlowTracker(int maxPoints) {
+    mMaxPoints = maxPoints;
+    mDownscale = 1;
+    mSmallSize = cvSize(0, 0);
+    mCount = mInitialCount = 0;
+    mCenter = cvPoint2D32f(0, 0);
+    mSize = cvSize2D32f(0, 0);
+    mLost = true;
+    mPrevImg = mPrevPyramid = mPyramid = 0;
+    mPrevWindow = cvRect(0, 0, 0, 0);
+    mFrames = 0;
+    mSurvival = 0;
+    mTrackTime = 0;
+
+    mPrevPoints = new CvPoint2D32f[mMaxPoints];
+    mPoints = new CvPoint2D32f[mMaxPoints];
+    mWindowPoints = new CvPoint2D32f[mMaxPoints];
+    mStatus = new char[mMaxPoints];
+    mError = new float[mMaxPoints];
+    mMedianBuffer = new float[MAX(2 * mMaxPoints, mMaxPoints * (mMaxPoints - 1) / 2)];
+}
+
+FlowTracker::~FlowTracker() {
+    updateBuffers(cvSize(0, 0));
+
+    delete [] mPrevPoints;
+    delete [] mPoints;
+    delete [] mWindowPoints;
+    delete [] mStatus;
+    delete [] mError;
+    delete [] mMedianBuffer;
+}
+
+// Buffers for the whole reduced image, the windows use a part of them. A 0x0 size only releases them
+void FlowTracker::updateBuffers(CvSize size) {
+    if(mPrevImg && mPrevImg->width == size.width && mPrevImg->height == size.height) return;
+
+    if(mPrevImg) {
+        cvReleaseImage(&mPrevImg);
+        cvReleaseImage(&mPrevPyramid);
+        cvReleaseImage(&mPyramid);
+    }
+
+    if(size.width > 0 && size.height > 0) {
+        // The size cvCalcOpticalFlowPyrLK asks for the pyramid buffers
+        mPrevImg = cvCreateImage(size, 8, 1);
+        mPrevPyramid = cvCreateImage(cvSize(size.width + 8, size.height / 3), 8, 1);
+        mPyramid = cvCreateImage(cvSize(size.width + 8, size.height / 3), 8, 1);
+    }
+}
+
+bool FlowTracker::startTracking(FrameImages *images, CvRect rect, double downscale) {
+    mDownscale = MAX(1, cvRound(downscale));
+    CvSize size = images->size();
+    mSmallSize = cvSize(size.width / mDownscale, size.height / mDownscale);
+    updateBuffers(mSmallSize);
+
+    mCenter = cvPoint2D32f((rect.x + rect.width * 0.5) / mDownscale, (rect.y + rect.height * 0.5) / mDownscale);
+    mSize = cvSize2D32f((float)rect.width / mDownscale, (float)rect.height / mDownscale);
+    mPrevWindow = searchWindow(mSmallSize);
+    IplImage *small = images->smallGray(mDownscale, mPrevWindow);
+
+    // Features of the inner part of the face, the borders have background
+    int x1 = MAX(0, cvRound(mCenter.x - mSize.width * 0.4)), y1 = MAX(0, cvRound(mCenter.y - mSize.height * 0.4));
+    int x2 = MIN(small->width, cvRound(mCenter.x + mSize.width * 0.4));
+    int y2 = MIN(small->height, cvRound(mCenter.y + mSize.height * 0.4));
+    mCount = 0;
+
+    if(x2 - x1 >= 8 && y2 - y1 >= 8) {
+        CvRect inner = cvRect(x1, y1, x2 - x1, y2 - y1);
+        IplImage *eigImg = cvCreateImage(cvSize(inner.width, inner.height), IPL_DEPTH_32F, 1);
+        IplImage *tempImg = cvCreateImage(cvSize(inner.width, inner.height), IPL_DEPTH_32F, 1);
+
+        mCount = mMaxPoints;
+        cvSetImageROI(small, inner);
+        cvGoodFeaturesToTrack(small, eigImg, tempImg, mPoints, &mCount, 0.01, 3, 0, 3, 0, 0.04);
+        cvResetImageROI(small);
+
+        cvReleaseImage(&eigImg);
+        cvReleaseImage(&tempImg);
+
+        for(int i = 0; i < mCount; i++) {
+            mPoints[i].x += inner.x;
+            mPoints[i].y += inner.y;
+        }
+    }
+
+    mInitialCount = mCount;
+    mLost = mCount < 4;
+    mFrames = 0;
+
+    keepWindow(small);
+
+    return !mLost;
+}
+
+CvBox2D FlowTracker::trackFace(FrameImages *images) {
+    double timeElapsed = (double)cvGetTickCount();
+    if(mLost) return frameBox();
+
+    CvRect window = mPrevWindow;
+    IplImage *small = images->smallGray(mDownscale, window);
+    int tracked = mCount;
+
+    // Flow between the same window of the previous and the current frame (window coordinates)
+    for(int i = 0; i < mCount; i++) {
+        mPrevPoints[i] = mPoints[i];
+        mWindowPoints[i] = cvPoint2D32f(mPoints[i].x - window.x, mPoints[i].y - window.y);
+    }
+
+    cvSetImageROI(mPrevImg, window);
+    cvSetImageROI(small, window);
+    CvPoint2D32f *found = mPoints;
+    cvCalcOpticalFlowPyrLK(mPrevImg, small, mPrevPyramid, mPyramid, mWindowPoints, found, mCount, cvSize(7, 7), 2,
+                           mStatus, mError, cvTermCriteria(CV_TERMCRIT_ITER | CV_TERMCRIT_EPS, 20, 0.03), 0);
+    cvResetImageROI(mPrevImg);
+    cvResetImageROI(small);
+
+    // Keep the points found inside the window, back to reduced image coordinates
+    int kept = 0;
+    for(int i = 0; i < mCount; i++) {
+        if(!mStatus[i] || found[i].x < 0 || found[i].y < 0 || found[i].x >= window.width || found[i].y >= window.height)
+            continue;
+        mPrevPoints[kept] = mPrevPoints[i];
+        mPoints[kept] = cvPoint2D32f(found[i].x + window.x, found[i].y + window.y);
+        kept++;
+    }
+    mCount = kept;
+
+    if(mCount < MAX(4, mInitialCount * 3 / 10)) {
+        mLost = true;
+    } else {
+        // Median shift
+        float *shifts = mMedianBuffer;
+        for(int i = 0; i < mCount; i++) shifts[i] = mPoints[i].x - mPrevPoints[i].x;
+        std::nth_element(shifts, shifts + mCount / 2, shifts + mCount);
+        float dx = shifts[mCount / 2];
+        for(int i = 0; i < mCount; i++) shifts[i] = mPoints[i].y - mPrevPoints[i].y;
+        std::nth_element(shifts, shifts + mCount / 2, shifts + mCount);
+        float dy = shifts[mCount / 2];
+
+        // Median scale change of the distances between the points
+        float *ratios = mMedianBuffer;
+        int pairs = 0;
+        for(int i = 0; i < mCount; i++) {
+            for(int j = i + 1; j < mCount; j++) {
+                float prevX = mPrevPoints[i].x - mPrevPoints[j].x, prevY = mPrevPoints[i].y - mPrevPoints[j].y;
+                float x = mPoints[i].x - mPoints[j].x, y = mPoints[i].y - mPoints[j].y;
+                float prevDistance = prevX * prevX + prevY * prevY;
+                if(prevDistance > 1) ratios[pairs++] = sqrt((x * x + y * y) / prevDistance);
+            }
+        }
+        float scale = 1;
+        if(pairs > 0) {
+            std::nth_element(ratios, ratios + pairs / 2, ratios + pairs);
+            scale = ratios[pairs / 2];
+        }
+
+        mCenter.x += dx;
+        mCenter.y += dy;
+        mSize.width *= scale;
+        mSize.height *= scale;
+
+        mPrevWindow = searchWindow(mSmallSize);
+        keepWindow(images->smallGray(mDownscale, mPrevWindow));
+    }
+
+    // Statistics
+    timeElapsed = ((double)cvGetTickCount() - timeElapsed)/((double)cvGetTickFrequency()*1000);
+    double survival = tracked ? (double)mCount / tracked : 0;
+    mSurvival = mFrames ? 0.9 * mSurvival + 0.1 * survival : survival;
+    mTrackTime = mFrames ? 0.9 * mTrackTime + 0.1 * timeElapsed : timeElapsed;
+    mFrames++;
+
+    return frameBox();
+}
+
+// The face with a margin of half its size, enough for the motion between two frames
+CvRect FlowTracker::searchWindow(CvSize size) const {
+    int x1 = MAX(0, cvFloor(mCenter.x - mSize.width)), y1 = MAX(0, cvFloor(mCenter.y - mSize.height));
+    int x2 = MIN(size.width, cvCeil(mCenter.x + mSize.width)), y2 = MIN(size.height, cvCeil(mCenter.y + mSize.height));
+
+    return cvRect(x1, y1, MAX(1, x2 - x1), MAX(1, y2 - y1));
+}
+
+// The next frame only needs the window of this one
+void FlowTracker::keepWindow(IplImage *image) {
+    cvSetImageROI(image, mPrevWindow);
+    cvSetImageROI(mPrevImg, mPrevWindow);
+    cvCopy(image, mPrevImg, 0);
+    cvResetImageROI(image);
+    cvResetImageROI(mPrevImg);
+}
+
+// Face box on frame coordinates
+CvBox2D FlowTracker::frameBox() const {
+    CvBox2D box;
+    box.center = cvPoint2D32f(mCenter.x * mDownscale, mCenter.y * mDownscale);
+    box.size = cvSize2D32f(mSize.width * mDownscale, mSize.height * mDownscale);
+    box.angle = 0;
+    return box;
+}
+
+bool FlowTracker::isLost() const {
+    return mLost;
+}
+
+int FlowTracker::points() const {
+    return mCount;
+}
+
+// Smoothed fraction of the points that survive each frame
+double FlowTracker::survival() const {
+    return mSurvival;
+}
+
+// Smoothed milliseconds per trackFace()
+double FlowTracker::trackTime() const {
+    return mTrackTime;
+}
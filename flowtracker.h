@@ -0,0 +1,79 @@
+/*
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef FLOWTRACKER_H
+#define FLOWTRACKER_H
+
+#include "cv.h"
+
+#include "frameimages.h"
+
+// Pyramidal Lucas-Kanade tracker of a few feature points of the face, on the gray image reduced by the
+// downscale of the detection (rounded to an integer factor). Only a window around the face is converted,
+// reduced and searched, so the cost per frame depends on the number of points and the face size, not on
+// the frame size. The face moves with the median shift of the points and scales with the median change of
+// their distances (median flow).
+class FlowTracker {
+    public:
+        FlowTracker(int maxPoints = 32);
+        ~FlowTracker();
+
+    public:
+        // The face rect is in frame coordinates, the tracking runs on the frame reduced by 'downscale'.
+        // Returns false if the face hasn't enough features to track
+        bool startTracking(FrameImages *images, CvRect rect, double downscale);
+        CvBox2D trackFace(FrameImages *images);
+        bool isLost() const;
+
+        // Statistics
+        int points() const;
+        double survival() const;
+        double trackTime() const;
+
+    private:
+        CvRect searchWindow(CvSize size) const;
+        void keepWindow(IplImage *image);
+        void updateBuffers(CvSize size);
+        CvBox2D frameBox() const;
+
+    private:
+        int mMaxPoints;
+        int mDownscale;
+        CvSize mSmallSize;          // Of the reduced image
+
+        // Points and box on reduced image coordinates
+        CvPoint2D32f *mPrevPoints, *mPoints, *mWindowPoints;
+        char *mStatus;
+        float *mError;
+        float *mMedianBuffer;       // Shifts and distance ratios for the medians
+        int mCount;
+        int mInitialCount;
+        CvPoint2D32f mCenter;
+        CvSize2D32f mSize;
+        bool mLost;
+
+        IplImage *mPrevImg;         // Previous frame, only the window is kept
+        CvRect mPrevWindow;
+        IplImage *mPrevPyramid, *mPyramid;
+
+        int mFrames;
+        double mSurvival;           // Smoothed fraction of the points kept per frame
+        double mTrackTime;          // Smoothed milliseconds per frame
+};
+
+#endif // FLOWTRACKER_H
@@ -0,0 +1,156 @@
+/*
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include "frame.h"
+
+#include <QMutexLocker>
+
+FrameInfo::FrameInfo() {
+    sequence = 0;
+    timestamp = 0;
+    origin = IPL_ORIGIN_TL;
+    flipH = flipV = false;
+    hasImage = true;
+    hasLuma = false;
+}
+
+Frame::Frame() {
+    mBuffer = 0;
+}
+
+Frame::Frame(Buffer *buffer) {
+    mBuffer = buffer;
+    if(mBuffer) mBuffer->refs.ref();
+}
+
+Frame::Frame(const Frame &other) {
+    mBuffer = other.mBuffer;
+    if(mBuffer) mBuffer->refs.ref();
+}
+
+Frame::~Frame() {
+    release();
+}
+
+Frame &Frame::operator=(const Frame &other) {
+    if(other.mBuffer) other.mBuffer->refs.ref();
+    release();
+    mBuffer = other.mBuffer;
+    return *this;
+}
+
+bool Frame::isNull() const {
+    return !mBuffer;
+}
+
+bool Frame::isShared() const {
+    return mBuffer && mBuffer->refs > 1;
+}
+
+// The last copy gives the buffer back to its pool
+void Frame::release() {
+    if(mBuffer && !mBuffer->refs.deref()) mBuffer->pool->recycle(mBuffer);
+    mBuffer = 0;
+}
+
+IplImage *Frame::image() const {
+    return mBuffer ? mBuffer->image : 0;
+}
+
+IplImage *Frame::luma() const {
+    return mBuffer && mBuffer->info.hasLuma ? mBuffer->luma : 0;
+}
+
+const FrameInfo &Frame::info() const {
+    static const FrameInfo nullInfo;
+    return mBuffer ? mBuffer->info : nullInfo;
+}
+
+void Frame::setInfo(const FrameInfo &info) {
+    if(mBuffer) mBuffer->info = info;
+}
+
+void Frame::fill(const IplImage *image, const IplImage *luma, const FrameInfo &info) {
+    if(!mBuffer || (!image && !luma)) return;
+
+    mBuffer->info = info;
+    mBuffer->info.origin = image ? image->origin : luma->origin;
+    mBuffer->info.hasImage = image != 0;
+    mBuffer->info.hasLuma = luma != 0 && mBuffer->luma;
+
+    bool flip = !(info.flipV ^ (mBuffer->info.origin == IPL_ORIGIN_TL));
+    if(image) {
+        if(flip) cvFlip(image, mBuffer->image, 0);
+            else cvCopy(image, mBuffer->image, 0);
+        if(info.flipH) cvFlip(mBuffer->image, mBuffer->image, 1);
+    }
+    if(mBuffer->info.hasLuma) {
+        if(flip) cvFlip(luma, mBuffer->luma, 0);
+            else cvCopy(luma, mBuffer->luma, 0);
+        if(info.flipH) cvFlip(mBuffer->luma, mBuffer->luma, 1);
+    }
+}
+
+
+FramePool::FramePool(CvSize size, int depth, int channels, int frames, bool luma) {
+    mBuffers.reserve(frames);
+    mFree.reserve(frames);
+
+    for(int i = 0; i < frames; i++) {
+        Frame::Buffer *buffer = new Frame::Buffer();
+        buffer->image = cvCreateImage(size, depth, channels);
+        buffer->luma = luma ? cvCreateImage(size, 8, 1) : 0;
+        buffer->pool = this;
+        mBuffers.append(buffer);
+        mFree.append(buffer);
+    }
+}
+
+FramePool::~FramePool() {
+    foreach(Frame::Buffer *buffer, mBuffers) {
+        cvReleaseImage(&buffer->image);
+        if(buffer->luma) cvReleaseImage(&buffer->luma);
+        delete buffer;
+    }
+}
+
+Frame FramePool::acquire() {
+    QMutexLocker locker(&mLock);
+    if(mFree.isEmpty()) return Frame();
+
+    Frame::Buffer *buffer = mFree.last();
+    mFree.pop_back();
+    buffer->info = FrameInfo();
+
+    return Frame(buffer);
+}
+
+int FramePool::available() const {
+    QMutexLocker locker(&mLock);
+    return mFree.size();
+}
+
+int FramePool::size() const {
+    return mBuffers.size();
+}
+
+// The free list has the capacity of all the buffers, so nothing is allocated here
+void FramePool::recycle(Frame::Buffer *buffer) {
+    QMutexLocker locker(&mLock);
+    mFree.append(buffer);
+}
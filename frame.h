@@ -0,0 +1,106 @@
+/*
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <QAtomicInt>
+#include <QMutex>
+#include <QVector>
+
+#include "cv.h"
+
+class FramePool;
+
+// Where a frame comes from and what was done to it
+struct FrameInfo {
+    FrameInfo();
+
+    qint64 sequence;
+    double timestamp;           // When the driver delivered the frame, in milliseconds (FrameQoS::now())
+    int origin;                 // Origin of the captured image (IPL_ORIGIN_TL or IPL_ORIGIN_BL)
+    bool flipH, flipV;          // Flips applied to the captured image
+    bool hasImage;              // The color image was filled (it's skipped when nothing needs it)
+    bool hasLuma;               // The luma plane was filled (sources with native luma)
+};
+
+// Pixels of a FramePool shared by reference count. Copying a Frame shares the pixels (no copy), the buffer
+// goes back to its pool when the last copy is released. The producer fills the image and the info before
+// sharing the frame, after that nobody can modify them.
+class Frame {
+    public:
+        Frame();
+        Frame(const Frame &other);
+        ~Frame();
+        Frame &operator=(const Frame &other);
+
+    public:
+        bool isNull() const;
+        bool isShared() const;
+        void release();
+
+        IplImage *image() const;
+        IplImage *luma() const;     // 0 if the frame doesn't have luma
+        const FrameInfo &info() const;
+        void setInfo(const FrameInfo &info);
+
+        // Copies a captured image and/or its luma plane (either can be 0), top-left and with the flips of
+        // 'info'. The origin and what the frame has are set on the info
+        void fill(const IplImage *image, const IplImage *luma, const FrameInfo &info);
+
+    private:
+        friend class FramePool;
+
+        struct Buffer {
+            IplImage *image;
+            IplImage *luma;
+            FrameInfo info;
+            QAtomicInt refs;
+            FramePool *pool;
+        };
+
+        Frame(Buffer *buffer);
+
+    private:
+        Buffer *mBuffer;
+};
+
+// A fixed number of frame buffers of the same format, allocated once. With 'luma' each buffer
+// has an 8 bits plane for the luma of the sources that deliver it too
+class FramePool {
+    public:
+        FramePool(CvSize size, int depth, int channels, int frames, bool luma = false);
+        ~FramePool();               // All the frames must be released before
+
+    public:
+        // Null frame if all the buffers are in use
+        Frame acquire();
+        int available() const;
+        int size() const;
+
+    private:
+        friend class Frame;
+        void recycle(Frame::Buffer *buffer);
+
+    private:
+        mutable QMutex mLock;
+        QVector<Frame::Buffer *> mBuffers;
+        QVector<Frame::Buffer *> mFree;
+};
+
+#endif // FRAME_H
@@ -0,0 +1,204 @@
+/*
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include "framedump.h"
+
+#include <string.h>
+
+static const char frameDumpMagic[8] = { 'Q', 'C', 'V', 'R', 'A', 'W', '0', '1' };
+static const quint32 frameDumpVersion = 1;
+
+static qint64 aligned(qint64 size, int alignment) {
+    return (size + alignment - 1) & ~(qint64)(alignment - 1);
+}
+
+FrameDumpWriter::FrameDumpWriter() {
+    memset(&mHeader, 0, sizeof(mHeader));
+    mFrame = 0;
+}
+
+FrameDumpWriter::~FrameDumpWriter() {
+    close();
+}
+
+bool FrameDumpWriter::open(const QString &filename, CvSize size, FrameDumpHeader::Format format) {
+    close();
+
+    mFile.setFileName(filename);
+    if(!mFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) return false;
+
+    memset(&mHeader, 0, sizeof(mHeader));
+    memcpy(mHeader.magic, frameDumpMagic, sizeof(mHeader.magic));
+    mHeader.version = frameDumpVersion;
+    mHeader.width = size.width;
+    mHeader.height = size.height;
+    mHeader.format = format;
+    mHeader.stride = aligned(size.width * (format == FrameDumpHeader::Bgr24 ? 3 : 1), 16);
+    mHeader.recordSize = aligned(sizeof(FrameDumpRecord) + (qint64)mHeader.stride * size.height, FrameDumpAlignment);
+    mFrame = 0;
+
+    static const char padding[FrameDumpAlignment] = { 0 };
+    mFile.write((const char *)&mHeader, sizeof(mHeader));
+    mFile.write(padding, FrameDumpAlignment - sizeof(mHeader));
+
+    return true;
+}
+
+void FrameDumpWriter::close() {
+    if(mFile.isOpen()) mFile.close();
+}
+
+bool FrameDumpWriter::isOpen() const {
+    return mFile.isOpen();
+}
+
+QString FrameDumpWriter::fileName() const {
+    return mFile.fileName();
+}
+
+// Appends a record: header, the rows padded to the stride and the padding to the record size
+void FrameDumpWriter::write(const IplImage *image, qint64 timestamp) {
+    if(!mFile.isOpen()) return;
+
+    FrameDumpRecord record;
+    memset(&record, 0, sizeof(record));
+    record.frame = mFrame++;
+    record.flags = image->origin == IPL_ORIGIN_BL ? FrameDumpRecord::BottomLeft : 0;
+    record.timestamp = timestamp;
+    mFile.write((const char *)&record, sizeof(record));
+
+    static const char padding[FrameDumpAlignment] = { 0 };
+    int rowBytes = image->width * image->nChannels;
+    if(image->widthStep == (int)mHeader.stride) {
+        mFile.write(image->imageData, (qint64)mHeader.stride * mHeader.height);
+    } else {
+        for(quint32 y = 0; y < mHeader.height; y++) {
+            mFile.write(image->imageData + y * image->widthStep, rowBytes);
+            mFile.write(padding, mHeader.stride - rowBytes);
+        }
+    }
+
+    qint64 size = sizeof(record) + (qint64)mHeader.stride * mHeader.height;
+    mFile.write(padding, mHeader.recordSize - size);
+}
+
+
+FrameDumpSource::FrameDumpSource(const QString &filename) {
+    mData = 0;
+    mHeader = 0;
+    mFrames = 0;
+    mPosition = 0;
+    mTimestamp = 0;
+    mBgr = 0;
+    mBgrValid = false;
+
+    mFile.setFileName(filename);
+    if(!mFile.open(QIODevice::ReadOnly)) return;
+
+    qint64 size = mFile.size();
+    if(size >= FrameDumpAlignment) mData = mFile.map(0, size);
+    if(!mData) {
+        mFile.close();
+        return;
+    }
+
+    const FrameDumpHeader *header = (const FrameDumpHeader *)mData;
+    bool valid = memcmp(header->magic, frameDumpMagic, sizeof(header->magic)) == 0 && header->version == frameDumpVersion
+                 && (header->format == FrameDumpHeader::Bgr24 || header->format == FrameDumpHeader::Gray8)
+                 && header->stride >= header->width * (header->format == FrameDumpHeader::Bgr24 ? 3 : 1)
+                 && header->recordSize >= sizeof(FrameDumpRecord) + (qint64)header->stride * header->height;
+    if(!valid) {
+        mFile.unmap(mData);
+        mFile.close();
+        mData = 0;
+        return;
+    }
+
+    mHeader = header;
+    mFrames = (size - FrameDumpAlignment) / header->recordSize;
+
+    int channels = header->format == FrameDumpHeader::Bgr24 ? 3 : 1;
+    cvInitImageHeader(&mImage, cvSize(header->width, header->height), 8, channels, IPL_ORIGIN_TL, 4);
+    mImage.widthStep = header->stride;
+    mImage.imageSize = header->stride * header->height;
+    if(channels == 1) mBgr = cvCreateImage(cvSize(header->width, header->height), 8, 3);
+}
+
+FrameDumpSource::~FrameDumpSource() {
+    if(mData) mFile.unmap(mData);
+    if(mBgr) cvReleaseImage(&mBgr);
+}
+
+bool FrameDumpSource::isOpen() const {
+    return mHeader != 0;
+}
+
+IplImage *FrameDumpSource::queryFrame() {
+    return grabFrame() ? retrieveFrame() : 0;
+}
+
+// Points the image header to the next record, nothing is copied
+bool FrameDumpSource::grabFrame() {
+    if(!mHeader || mPosition >= mFrames) return false;
+
+    uchar *record = mData + FrameDumpAlignment + (qint64)mPosition * mHeader->recordSize;
+    const FrameDumpRecord *info = (const FrameDumpRecord *)record;
+    mImage.imageData = mImage.imageDataOrigin = (char *)record + sizeof(FrameDumpRecord);
+    mImage.origin = (info->flags & FrameDumpRecord::BottomLeft) ? IPL_ORIGIN_BL : IPL_ORIGIN_TL;
+    mTimestamp = info->timestamp;
+    mBgrValid = false;
+
+    mPosition++;
+    return true;
+}
+
+IplImage *FrameDumpSource::retrieveFrame() {
+    if(!mHeader || !mImage.imageData) return 0;
+    if(!mBgr) return &mImage;
+
+    if(!mBgrValid) {
+        cvCvtColor(&mImage, mBgr, CV_GRAY2BGR);
+        mBgr->origin = mImage.origin;
+        mBgrValid = true;
+    }
+    return mBgr;
+}
+
+IplImage *FrameDumpSource::retrieveLuma() {
+    return (mBgr && mImage.imageData) ? &mImage : 0;
+}
+
+const FrameDumpHeader *FrameDumpSource::header() const {
+    return mHeader;
+}
+
+int FrameDumpSource::frameCount() const {
+    return mFrames;
+}
+
+int FrameDumpSource::position() const {
+    return mPosition;
+}
+
+void FrameDumpSource::seek(int frame) {
+    mPosition = qBound(0, frame, mFrames);
+}
+
+qint64 FrameDumpSource::timestamp() const {
+    return mTimestamp;
+}
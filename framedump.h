@@ -0,0 +1,116 @@
+/*
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef FRAMEDUMP_H
+#define FRAMEDUMP_H
+
+#include <QFile>
+#include <QString>
+
+#include "cv.h"
+
+#include "framesource.h"
+
+/* Raw dump of the frames of a camera, to replay exactly what it produced (no codec in between).
+   Little-endian, fixed size records so frame N is at a known offset:
+
+    FrameDumpHeader                                     (padded to FrameDumpAlignment)
+    FrameDumpRecord, rows (stride bytes each), padding  (recordSize bytes, one per frame)
+    ...
+
+   Records and rows are aligned for the SIMD loads of the pipeline. The frame count comes from the
+   file size, so a dump that wasn't closed is still valid up to its last complete record. */
+
+enum { FrameDumpAlignment = 64 };
+
+struct FrameDumpHeader {
+    enum Format { Bgr24 = 1, Gray8 = 2 };
+
+    char magic[8];              // "QCVRAW01"
+    quint32 version;
+    quint32 width;
+    quint32 height;
+    quint32 format;
+    quint32 stride;             // Bytes per row
+    quint32 recordSize;         // Record header, rows and padding
+};
+
+struct FrameDumpRecord {
+    enum Flags { BottomLeft = 1 };  // The rows are stored bottom-up (IPL_ORIGIN_BL)
+
+    quint32 frame;
+    quint32 flags;
+    qint64 timestamp;           // Microseconds since the recording started
+    char reserved[FrameDumpAlignment - 16];
+};
+
+// Sequential writer, used while recording
+class FrameDumpWriter {
+    public:
+        FrameDumpWriter();
+        ~FrameDumpWriter();
+
+    public:
+        bool open(const QString &filename, CvSize size, FrameDumpHeader::Format format);
+        void close();
+        bool isOpen() const;
+        QString fileName() const;
+
+        // The image must have the size and format of the dump
+        void write(const IplImage *image, qint64 timestamp);
+
+    private:
+        QFile mFile;
+        FrameDumpHeader mHeader;
+        quint32 mFrame;
+};
+
+// Replays a dump from the memory-mapped file, the frames returned point into the mapping (no copies).
+// The source doesn't wait: the caller paces the frames with their timestamps or reads them at full speed
+class FrameDumpSource : public FrameSource {
+    public:
+        FrameDumpSource(const QString &filename);
+        ~FrameDumpSource();
+
+    public:
+        bool isOpen() const;
+        IplImage *queryFrame();             // 0 at the end
+
+        bool grabFrame();
+        IplImage *retrieveFrame();          // Gray8 dumps are converted to BGR
+        IplImage *retrieveLuma();           // Only Gray8 dumps have it
+
+        const FrameDumpHeader *header() const;
+        int frameCount() const;
+        int position() const;               // Next frame
+        void seek(int frame);
+        qint64 timestamp() const;           // Of the last frame grabbed
+
+    private:
+        QFile mFile;
+        uchar *mData;
+        const FrameDumpHeader *mHeader;
+        int mFrames;
+        int mPosition;
+        qint64 mTimestamp;
+        IplImage mImage;                    // Header of the last frame, its data is on the mapping
+        IplImage *mBgr;                     // Converted Gray8 frame
+        bool mBgrValid;
+};
+
+#endif // FRAMEDUMP_H
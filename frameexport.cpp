@@ -0,0 +1,487 @@
+/*
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include "frameexport.h"
+
+#include <string.h>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#endif
+
+// Orders the seqlock counters with the slot accesses around them. x86 doesn't reorder loads with loads
+// or stores with stores, with MSVC it's enough that the compiler doesn't move them
+#ifdef Q_CC_MSVC
+#include <intrin.h>
+#pragma intrinsic(_ReadWriteBarrier)
+#define EXPORT_BARRIER() _ReadWriteBarrier()
+#else
+#define EXPORT_BARRIER() __sync_synchronize()
+#endif
+
+static const char exportMagic[8] = { 'Q', 'C', 'V', 'S', 'H', 'M', '0', '2' };
+static const quint32 exportVersion = 2;
+
+static int alignedSize(int size) {
+    return (size + 7) & ~7;
+}
+
+static int headerSize() {
+    return alignedSize(sizeof(ExportHeader));
+}
+
+static inline int loadAcquire(const volatile qint32 *value) {
+    int result = *value;
+    EXPORT_BARRIER();
+    return result;
+}
+
+static inline void storeRelease(volatile qint32 *value, int newValue) {
+    EXPORT_BARRIER();
+    *value = newValue;
+}
+
+static quint32 currentProcess() {
+#ifdef Q_OS_WIN
+    return GetCurrentProcessId();
+#else
+    return getpid();
+#endif
+}
+
+static bool isRunning(quint32 process) {
+#ifdef Q_OS_WIN
+    HANDLE handle = OpenProcess(SYNCHRONIZE, FALSE, process);
+    if(!handle) return GetLastError() == ERROR_ACCESS_DENIED;
+    bool running = WaitForSingleObject(handle, 0) == WAIT_TIMEOUT;
+    CloseHandle(handle);
+    return running;
+#else
+    return kill(process, 0) == 0 || errno == EPERM;
+#endif
+}
+
+ExportView::ExportView() {
+    sequence = -1;
+    timestamp = 0;
+    hasTrack = false;
+    pixels = 0;
+    stride = 0;
+    slot = -1;
+    lock = 0;
+}
+
+
+#ifdef Q_OS_WIN
+
+SharedSegment::SharedSegment() {
+}
+
+SharedSegment::~SharedSegment() {
+    detach();
+}
+
+SharedSegment::Result SharedSegment::create(const QString &name, int size) {
+    detach();
+
+    mMemory.setKey(name);
+    if(mMemory.create(size)) return Created;
+    return mMemory.error() == QSharedMemory::AlreadyExists ? Exists : Failed;
+}
+
+bool SharedSegment::attach(const QString &name, bool readOnly) {
+    detach();
+
+    mMemory.setKey(name);
+    return mMemory.attach(readOnly ? QSharedMemory::ReadOnly : QSharedMemory::ReadWrite);
+}
+
+void SharedSegment::detach() {
+    if(mMemory.isAttached()) mMemory.detach();
+}
+
+bool SharedSegment::remove(const QString &) {
+    return false;
+}
+
+bool SharedSegment::isAttached() const {
+    return mMemory.isAttached();
+}
+
+void *SharedSegment::data() const {
+    return const_cast<void *>(mMemory.constData());
+}
+
+int SharedSegment::size() const {
+    return mMemory.size();
+}
+
+QString SharedSegment::errorString() const {
+    return mMemory.errorString();
+}
+
+#else
+
+static QByteArray segmentPath(const QString &name) {
+    return QByteArray("/") + name.toLocal8Bit();
+}
+
+SharedSegment::SharedSegment() {
+    mData = 0;
+    mSize = 0;
+    mOwner = false;
+}
+
+SharedSegment::~SharedSegment() {
+    detach();
+}
+
+// Fails with Exists instead of opening a segment somebody else created
+SharedSegment::Result SharedSegment::create(const QString &name, int size) {
+    detach();
+
+    QByteArray path = segmentPath(name);
+    int fd = shm_open(path, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if(fd < 0) {
+        if(errno == EEXIST) return Exists;
+        mError = QString("shm_open: %1").arg(strerror(errno));
+        return Failed;
+    }
+
+    // ftruncate fills it with zeros
+    void *data = MAP_FAILED;
+    if(ftruncate(fd, size) == 0) data = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(data == MAP_FAILED) {
+        mError = QString("mmap: %1").arg(strerror(errno));
+        ::close(fd);
+        shm_unlink(path);
+        return Failed;
+    }
+    ::close(fd);
+
+    mPath = path;
+    mData = data;
+    mSize = size;
+    mOwner = true;
+    return Created;
+}
+
+bool SharedSegment::attach(const QString &name, bool readOnly) {
+    detach();
+
+    QByteArray path = segmentPath(name);
+    int fd = shm_open(path, readOnly ? O_RDONLY : O_RDWR, 0);
+    if(fd < 0) {
+        mError = QString("shm_open: %1").arg(strerror(errno));
+        return false;
+    }
+
+    struct stat info;
+    void *data = MAP_FAILED;
+    if(fstat(fd, &info) == 0 && info.st_size > 0)
+        data = mmap(0, info.st_size, readOnly ? PROT_READ : PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if(data == MAP_FAILED) {
+        mError = QString("mmap: %1").arg(strerror(errno));
+        return false;
+    }
+
+    mPath = path;
+    mData = data;
+    mSize = info.st_size;
+    mOwner = false;
+    return true;
+}
+
+// The creator removes the name, the processes that still map it keep their mapping
+void SharedSegment::detach() {
+    if(!mData) return;
+
+    munmap(mData, mSize);
+    if(mOwner) shm_unlink(mPath);
+    mData = 0;
+    mSize = 0;
+    mOwner = false;
+}
+
+bool SharedSegment::remove(const QString &name) {
+    return shm_unlink(segmentPath(name)) == 0;
+}
+
+bool SharedSegment::isAttached() const {
+    return mData != 0;
+}
+
+void *SharedSegment::data() const {
+    return mData;
+}
+
+int SharedSegment::size() const {
+    return mSize;
+}
+
+QString SharedSegment::errorString() const {
+    return mError;
+}
+
+#endif
+
+
+FrameExport::FrameExport() {
+    mSequence = 0;
+}
+
+FrameExport::~FrameExport() {
+    close();
+}
+
+QString FrameExport::key(int camera) {
+    return QString("QtOpenCV-camera%1").arg(camera);
+}
+
+// The memory is created by the writer. One that already exists is only taken over when its writer isn't running
+bool FrameExport::open(int camera, CvSize size, int slotCount) {
+    close();
+    mError.clear();
+
+    ExportHeader layout;
+    memset(&layout, 0, sizeof(layout));
+    layout.slotCount = slotCount;
+    layout.width = size.width;
+    layout.height = size.height;
+    layout.channels = 3;
+    layout.stride = alignedSize(size.width * 3);
+    layout.slotSize = alignedSize(sizeof(ExportSlot) + layout.stride * size.height);
+    int total = headerSize() + layout.slotSize * slotCount;
+
+    SharedSegment::Result result = mMemory.create(key(camera), total);
+    if(result == SharedSegment::Failed) return false;
+    if(result == SharedSegment::Exists && !takeOver(key(camera), layout, total)) return false;
+
+    ExportHeader *header = (ExportHeader *)mMemory.data();
+    storeRelease(&header->latest, -1);
+    header->version = exportVersion;
+    header->slotCount = layout.slotCount;
+    header->width = layout.width;
+    header->height = layout.height;
+    header->channels = layout.channels;
+    header->stride = layout.stride;
+    header->slotSize = layout.slotSize;
+    header->writer = currentProcess();
+
+    // The magic goes last, readers don't use the header before it's there
+    EXPORT_BARRIER();
+    memcpy(header->magic, exportMagic, sizeof(header->magic));
+    mSequence = 0;
+
+    return true;
+}
+
+// Refused while the writer of the segment runs. Otherwise it was left by a writer that crashed: POSIX keeps
+// the name until it's removed, Windows keeps the segment while a reader has it open
+bool FrameExport::takeOver(const QString &name, const ExportHeader &layout, int size) {
+    if(!mMemory.attach(name, false)) return false;
+
+    ExportHeader *header = (ExportHeader *)mMemory.data();
+    bool valid = mMemory.size() >= headerSize() && memcmp(header->magic, exportMagic, sizeof(exportMagic)) == 0 &&
+                 header->version == exportVersion;
+    if(valid && isRunning(header->writer)) {
+        mError = QString("%1 is exported by process %2").arg(name).arg(header->writer);
+        mMemory.detach();
+        return false;
+    }
+
+#ifdef Q_OS_WIN
+    // A new one can't be created while the readers have it open: it's reused if the frames fit the same slots,
+    // the readers see the sequence start again
+    bool sameLayout = valid && mMemory.size() >= size && header->slotCount == layout.slotCount &&
+                      header->width == layout.width && header->height == layout.height &&
+                      header->stride == layout.stride && header->slotSize == layout.slotSize;
+    if(!sameLayout) {
+        mError = QString("%1 is still open by readers of another export").arg(name);
+        mMemory.detach();
+        return false;
+    }
+
+    // A slot the crashed writer left odd becomes even, its readers retry once more
+    storeRelease(&header->latest, -1);
+    for(quint32 i = 0; i < header->slotCount; i++) {
+        ExportSlot *slot = (ExportSlot *)((char *)mMemory.data() + headerSize() + i * header->slotSize);
+        if(slot->lock & 1) storeRelease(&slot->lock, slot->lock + 1);
+    }
+    return true;
+#else
+    // Replaced by a new segment under the same name. The readers that still map the old one stop getting
+    // frames and have to attach again
+    Q_UNUSED(layout);
+    mMemory.detach();
+    SharedSegment::remove(name);
+    return mMemory.create(name, size) == SharedSegment::Created;
+#endif
+}
+
+void FrameExport::close() {
+    mMemory.detach();
+}
+
+bool FrameExport::isOpen() const {
+    return mMemory.isAttached();
+}
+
+QString FrameExport::errorString() const {
+    return mError.isEmpty() ? mMemory.errorString() : mError;
+}
+
+void FrameExport::publish(const Frame &frame, const QVector<QRect> &faces, const CvBox2D *track) {
+    if(!mMemory.isAttached()) return;
+
+    ExportHeader *header = (ExportHeader *)mMemory.data();
+    const IplImage *image = frame.image();
+    if(image->width != (int)header->width || image->height != (int)header->height) return;
+
+    int sequence = mSequence;
+    mSequence = (mSequence + 1) & 0x7FFFFFFF;
+    char *base = (char *)mMemory.data() + headerSize() + (sequence % header->slotCount) * header->slotSize;
+    ExportSlot *slot = (ExportSlot *)base;
+
+    // Odd: the readers of this slot will retry. Only the writer changes it, the barrier keeps the slot
+    // writes after it
+    int lock = slot->lock;
+    slot->lock = lock + 1;
+    EXPORT_BARRIER();
+
+    slot->sequence = sequence;
+    slot->timestamp = frame.info().timestamp;
+    slot->faces = MIN(faces.size(), (int)ExportSlot::MaxFaces);
+    for(int i = 0; i < (int)slot->faces; i++) {
+        const QRect &face = faces.at(i);
+        slot->faceRects[i].x = face.x();
+        slot->faceRects[i].y = face.y();
+        slot->faceRects[i].width = face.width();
+        slot->faceRects[i].height = face.height();
+    }
+    slot->tracks = track ? 1 : 0;
+    if(track) {
+        slot->track.cx = track->center.x;
+        slot->track.cy = track->center.y;
+        slot->track.width = track->size.width;
+        slot->track.height = track->size.height;
+        slot->track.angle = track->angle;
+    }
+
+    uchar *pixels = (uchar *)base + sizeof(ExportSlot);
+    for(int y = 0; y < image->height; y++)
+        memcpy(pixels + y * header->stride, image->imageData + y * image->widthStep, image->width * 3);
+
+    // Even again: the slot is consistent, then it becomes the latest one
+    storeRelease(&slot->lock, lock + 2);
+    storeRelease(&header->latest, sequence);
+}
+
+
+FrameExportReader::FrameExportReader() {
+}
+
+FrameExportReader::~FrameExportReader() {
+    detach();
+}
+
+bool FrameExportReader::attach(int camera) {
+    detach();
+
+    if(!mMemory.attach(FrameExport::key(camera), true)) return false;
+
+    if(mMemory.size() < headerSize() || memcmp(header()->magic, exportMagic, sizeof(exportMagic)) != 0 ||
+       header()->version != exportVersion || mMemory.size() < headerSize() + (int)(header()->slotSize * header()->slotCount)) {
+        detach();
+        return false;
+    }
+
+    return true;
+}
+
+void FrameExportReader::detach() {
+    mMemory.detach();
+}
+
+bool FrameExportReader::isAttached() const {
+    return mMemory.isAttached();
+}
+
+const ExportHeader *FrameExportReader::header() const {
+    return mMemory.isAttached() ? (const ExportHeader *)mMemory.data() : 0;
+}
+
+const ExportSlot *FrameExportReader::slot(int index) const {
+    return (const ExportSlot *)((const char *)mMemory.data() + headerSize() + index * header()->slotSize);
+}
+
+bool FrameExportReader::acquire(ExportView *view, int after) {
+    if(!mMemory.isAttached()) return false;
+    const ExportHeader *header = this->header();
+
+    for(int retry = 0; retry < 4; retry++) {
+        int latest = loadAcquire(&header->latest);
+        if(latest < 0 || latest == after) return false;
+
+        int index = latest % header->slotCount;
+        const ExportSlot *current = slot(index);
+        int lock = loadAcquire(&current->lock);
+        if(lock & 1) continue;
+
+        view->sequence = current->sequence;
+        view->timestamp = current->timestamp;
+        view->faces.clear();
+        for(int i = 0; i < (int)MIN(current->faces, (quint32)ExportSlot::MaxFaces); i++) {
+            const ExportRect &face = current->faceRects[i];
+            view->faces.append(QRect(face.x, face.y, face.width, face.height));
+        }
+        view->hasTrack = current->tracks > 0;
+        if(view->hasTrack) {
+            view->track.center = cvPoint2D32f(current->track.cx, current->track.cy);
+            view->track.size = cvSize2D32f(current->track.width, current->track.height);
+            view->track.angle = current->track.angle;
+        }
+        view->pixels = (const uchar *)current + sizeof(ExportSlot);
+        view->stride = header->stride;
+        view->slot = index;
+        view->lock = lock;
+
+        // The writer didn't touch the slot while we were reading it. The barrier completes the reads before
+        // the counter is loaded again
+        EXPORT_BARRIER();
+        if(current->lock == lock && view->sequence == latest) return true;
+    }
+
+    return false;
+}
+
+// Called after reading the pixels: the barrier completes those reads before the counter is checked
+bool FrameExportReader::isValid(const ExportView &view) {
+    if(!mMemory.isAttached() || view.slot < 0) return false;
+
+    EXPORT_BARRIER();
+    return slot(view.slot)->lock == view.lock;
+}
@@ -0,0 +1,176 @@
+/*
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef FRAMEEXPORT_H
+#define FRAMEEXPORT_H
+
+#include <QtGlobal>
+#ifdef Q_OS_WIN
+#include <QSharedMemory>
+#endif
+#include <QVector>
+#include <QRect>
+#include <QString>
+
+#include "cv.h"
+
+#include "frame.h"
+
+/* Frames and results of a camera published on shared memory for other local processes:
+
+    ExportHeader
+    ExportSlot + pixels         (slotCount slots, a ring: frame 'sequence' goes to slot sequence % slotCount)
+
+   There is a single writer and no locks. Each slot is protected by a seqlock: its counter is odd while the
+   writer changes it, so a reader takes the counter, reads the slot and checks the counter didn't change.
+   The counters are plain 32-bit loads and stores ordered with barriers, readers map the memory read-only. */
+
+struct ExportRect {
+    qint32 x, y, width, height;
+};
+
+struct ExportBox {
+    float cx, cy, width, height, angle;
+    float reserved;
+};
+
+struct ExportHeader {
+    char magic[8];              // "QCVSHM01"
+    quint32 version;
+    quint32 slotCount;
+    quint32 width, height;
+    quint32 channels;           // 3, BGR
+    quint32 stride;             // Bytes per pixel row
+    quint32 slotSize;           // Bytes of a slot, pixels included
+    volatile qint32 latest;     // Sequence of the last frame published, -1 before the first one
+    quint32 writer;             // Process id of the writer
+};
+
+struct ExportSlot {
+    enum { MaxFaces = 16 };
+
+    volatile qint32 lock;       // Seqlock counter
+    qint32 sequence;
+    double timestamp;           // Capture time in milliseconds
+    quint32 faces;
+    quint32 tracks;
+    ExportRect faceRects[MaxFaces];
+    ExportBox track;
+};
+
+// Frame read from the export. The metadata is a copy, the pixels point to the shared memory and they're
+// only valid while FrameExportReader::isValid() says so (the writer reuses the slot slotCount frames later)
+struct ExportView {
+    ExportView();
+
+    int sequence;
+    double timestamp;
+    QVector<QRect> faces;
+    bool hasTrack;
+    CvBox2D track;
+    const uchar *pixels;
+    int stride;
+
+    int slot;
+    int lock;
+};
+
+// Named shared memory: shm_open and mmap on POSIX, QSharedMemory on Windows. A POSIX segment stays until
+// it's removed, the writer removes it when it detaches; a Windows one goes away with the last process using it
+class SharedSegment {
+    public:
+        SharedSegment();
+        ~SharedSegment();
+
+    public:
+        enum Result { Created, Exists, Failed };
+
+        Result create(const QString &name, int size);
+        bool attach(const QString &name, bool readOnly);
+        void detach();
+        // POSIX only, Windows can't remove a segment that's still open
+        static bool remove(const QString &name);
+
+        bool isAttached() const;
+        void *data() const;
+        int size() const;
+        QString errorString() const;
+
+    private:
+#ifdef Q_OS_WIN
+        QSharedMemory mMemory;
+#else
+        QByteArray mPath;
+        void *mData;
+        int mSize;
+        bool mOwner;
+        QString mError;
+#endif
+};
+
+// Writer, owned by the OpenCVWidget of the camera
+class FrameExport {
+    public:
+        FrameExport();
+        ~FrameExport();
+
+    public:
+        static QString key(int camera);
+
+        bool open(int camera, CvSize size, int slotCount = 4);
+        void close();
+        bool isOpen() const;
+        QString errorString() const;
+
+        void publish(const Frame &frame, const QVector<QRect> &faces, const CvBox2D *track);
+
+    private:
+        bool takeOver(const QString &name, const ExportHeader &layout, int size);
+
+    private:
+        SharedSegment mMemory;
+        int mSequence;
+        QString mError;
+};
+
+// Reader library for the consumers
+class FrameExportReader {
+    public:
+        FrameExportReader();
+        ~FrameExportReader();
+
+    public:
+        bool attach(int camera);
+        void detach();
+        bool isAttached() const;
+        const ExportHeader *header() const;
+
+        // The latest frame if it's newer than 'after'. Returns false if there isn't a new frame
+        // or the writer kept changing it
+        bool acquire(ExportView *view, int after = -1);
+        // The slot of the view wasn't rewritten, its pixels are still the ones of the frame
+        bool isValid(const ExportView &view);
+
+    private:
+        const ExportSlot *slot(int index) const;
+
+    private:
+        SharedSegment mMemory;
+};
+
+#endif // FRAMEEXPORT_H
@@ -0,0 +1,245 @@
+/*
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include "frameimages.h"
+
+FrameImages::FrameImages() {
+    mFrame = 0;
+    mGray = mSmallGray = mEqualized = 0;
+    mRegionSmallGray = 0;
+    mHSV = mHue = mMask = 0;
+    mSmallBGR = mSmallHSV = 0;
+    mDownscale = 0;
+    mReduction = 0;
+    mRegionDownscale = 0;
+    mMaskVMin = mMaskVMax = mMaskSMin = 0;
+
+    setFrame(0);
+}
+
+FrameImages::~FrameImages() {
+    if(mGray) cvReleaseImage(&mGray);
+    if(mSmallGray) cvReleaseImage(&mSmallGray);
+    if(mEqualized) cvReleaseImage(&mEqualized);
+    if(mRegionSmallGray) cvReleaseImage(&mRegionSmallGray);
+    if(mHSV) cvReleaseImage(&mHSV);
+    if(mHue) cvReleaseImage(&mHue);
+    if(mMask) cvReleaseImage(&mMask);
+    if(mSmallBGR) cvReleaseImage(&mSmallBGR);
+    if(mSmallHSV) cvReleaseImage(&mSmallHSV);
+}
+
+void FrameImages::setFrame(IplImage *frame, IplImage *luma) {
+    mFrame = frame;
+    mLuma = luma;
+
+    mGrayValid = mSmallGrayValid = mEqualizedValid = mSmallHSVValid = false;
+    mGrayRegionValid = mRegionSmallGrayValid = cvRect(0, 0, 0, 0);
+    mHSVValid = mHueValid = mMaskValid = cvRect(0, 0, 0, 0);
+}
+
+IplImage *FrameImages::frame() const {
+    return mFrame;
+}
+
+CvSize FrameImages::size() const {
+    return mLuma ? cvGetSize(mLuma) : mFrame ? cvGetSize(mFrame) : cvSize(0, 0);
+}
+
+// (Re)allocate a buffer only when its size changes
+void FrameImages::updateImage(IplImage **image, CvSize size, int depth, int channels) {
+    if(*image && (*image)->width == size.width && (*image)->height == size.height) return;
+
+    if(*image) cvReleaseImage(image);
+    *image = cvCreateImage(size, depth, channels);
+}
+
+// Clips 'region' to the image size and extends 'valid' to cover it. Returns false if it was already covered,
+// otherwise 'region' is what has to be calculated
+bool FrameImages::extendRegion(CvRect *valid, CvRect *region, CvSize size) const {
+    int x1 = MAX(0, region->x), y1 = MAX(0, region->y);
+    int x2 = MIN(size.width, region->x + region->width), y2 = MIN(size.height, region->y + region->height);
+    *region = cvRect(x1, y1, MAX(0, x2 - x1), MAX(0, y2 - y1));
+
+    if(region->width == 0 || region->height == 0) return false;
+    if(valid->width > 0 && valid->height > 0) {
+        if(x1 >= valid->x && y1 >= valid->y && x2 <= valid->x + valid->width && y2 <= valid->y + valid->height)
+            return false;
+        *region = cvMaxRect(valid, region);
+    }
+
+    *valid = *region;
+    return true;
+}
+
+void FrameImages::setDownscale(double downscale) {
+    if(downscale == mDownscale) return;
+
+    mDownscale = downscale;
+    mSmallGrayValid = mEqualizedValid = false;
+}
+
+IplImage *FrameImages::gray() {
+    if(mLuma) return mLuma;
+
+    if(!mGrayValid) {
+        updateImage(&mGray, cvGetSize(mFrame), 8, 1);
+        cvCvtColor(mFrame, mGray, CV_BGR2GRAY);
+        mGrayValid = true;
+    }
+
+    return mGray;
+}
+
+// Only the region of the gray buffer is converted, the rest may be from other frames
+IplImage *FrameImages::gray(CvRect region) {
+    if(mLuma || mGrayValid) return gray();
+
+    updateImage(&mGray, cvGetSize(mFrame), 8, 1);
+    if(extendRegion(&mGrayRegionValid, &region, cvGetSize(mFrame))) {
+        CvMat source;
+        cvGetSubRect(mFrame, &source, region);
+        cvSetImageROI(mGray, region);
+        cvCvtColor(&source, mGray, CV_BGR2GRAY);
+        cvResetImageROI(mGray);
+    }
+
+    return mGray;
+}
+
+IplImage *FrameImages::smallGray(double downscale) {
+    setDownscale(downscale);
+
+    if(!mSmallGrayValid) {
+        IplImage *source = gray();
+        updateImage(&mSmallGray, cvSize(cvRound(source->width / downscale), cvRound(source->height / downscale)), 8, 1);
+        cvResize(source, mSmallGray);
+        mSmallGrayValid = true;
+    }
+
+    return mSmallGray;
+}
+
+IplImage *FrameImages::equalized(double downscale) {
+    IplImage *source = smallGray(downscale);
+
+    if(!mEqualizedValid) {
+        updateImage(&mEqualized, cvGetSize(source), 8, 1);
+        cvEqualizeHist(source, mEqualized);
+        mEqualizedValid = true;
+    }
+
+    return mEqualized;
+}
+
+IplImage *FrameImages::smallGray(int downscale, CvRect region) {
+    downscale = MAX(1, downscale);
+    CvSize size = FrameImages::size();
+    CvSize smallSize = cvSize(size.width / downscale, size.height / downscale);
+    if(downscale == 1) return gray(region);
+
+    if(downscale != mRegionDownscale) {
+        mRegionDownscale = downscale;
+        mRegionSmallGrayValid = cvRect(0, 0, 0, 0);
+    }
+    updateImage(&mRegionSmallGray, smallSize, 8, 1);
+
+    // The source region starts on a multiple of the factor, so the pixels are the same whatever the region
+    if(extendRegion(&mRegionSmallGrayValid, &region, smallSize)) {
+        CvRect sourceRegion = cvRect(region.x * downscale, region.y * downscale, region.width * downscale,
+                                     region.height * downscale);
+        CvMat source;
+        cvGetSubRect(gray(sourceRegion), &source, sourceRegion);
+        cvSetImageROI(mRegionSmallGray, region);
+        cvResize(&source, mRegionSmallGray, CV_INTER_AREA);
+        cvResetImageROI(mRegionSmallGray);
+    }
+
+    return mRegionSmallGray;
+}
+
+IplImage *FrameImages::hsv(CvRect region) {
+    updateImage(&mHSV, cvGetSize(mFrame), 8, 3);
+
+    // The frame can be shared with other threads, so its ROI isn't touched
+    if(extendRegion(&mHSVValid, &region, cvGetSize(mFrame))) {
+        CvMat source;
+        cvGetSubRect(mFrame, &source, region);
+        cvSetImageROI(mHSV, region);
+        cvCvtColor(&source, mHSV, CV_BGR2HSV);
+        cvResetImageROI(mHSV);
+    }
+
+    return mHSV;
+}
+
+IplImage *FrameImages::hue(CvRect region) {
+    updateImage(&mHue, cvGetSize(mFrame), 8, 1);
+
+    if(extendRegion(&mHueValid, &region, cvGetSize(mFrame))) {
+        IplImage *source = hsv(region);
+        cvSetImageROI(source, region);
+        cvSetImageROI(mHue, region);
+        cvSplit(source, mHue, 0, 0, 0);
+        cvResetImageROI(source);
+        cvResetImageROI(mHue);
+    }
+
+    return mHue;
+}
+
+// Pixels too dark, too bright or too unsaturated to have a reliable hue are masked out
+IplImage *FrameImages::mask(CvRect region, int vMin, int vMax, int sMin) {
+    updateImage(&mMask, cvGetSize(mFrame), 8, 1);
+
+    if(vMin != mMaskVMin || vMax != mMaskVMax || sMin != mMaskSMin) {
+        mMaskVMin = vMin;
+        mMaskVMax = vMax;
+        mMaskSMin = sMin;
+        mMaskValid = cvRect(0, 0, 0, 0);
+    }
+
+    if(extendRegion(&mMaskValid, &region, cvGetSize(mFrame))) {
+        IplImage *source = hsv(region);
+        cvSetImageROI(source, region);
+        cvSetImageROI(mMask, region);
+        cvInRangeS(source, cvScalar(0, sMin, MIN(vMin, vMax), 0), cvScalar(180, 256, MAX(vMin, vMax), 0), mMask);
+        cvResetImageROI(source);
+        cvResetImageROI(mMask);
+    }
+
+    return mMask;
+}
+
+IplImage *FrameImages::smallHSV(int reduction) {
+    if(reduction != mReduction) {
+        mReduction = reduction;
+        mSmallHSVValid = false;
+    }
+
+    if(!mSmallHSVValid) {
+        CvSize size = cvSize(mFrame->width / reduction, mFrame->height / reduction);
+        updateImage(&mSmallBGR, size, 8, 3);
+        updateImage(&mSmallHSV, size, 8, 3);
+        cvResize(mFrame, mSmallBGR, CV_INTER_NN);
+        cvCvtColor(mSmallBGR, mSmallHSV, CV_BGR2HSV);
+        mSmallHSVValid = true;
+    }
+
+    return mSmallHSV;
+}
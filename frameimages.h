@@ -0,0 +1,82 @@
+/*
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef FRAMEIMAGES_H
+#define FRAMEIMAGES_H
+
+#include "cv.h"
+
+// Images derived from a frame, shared by the stages that process it (face detection, skin filter, CamShift,
+// flow tracker).
+// Each view is calculated the first time a stage asks for it on a frame and reused by the rest; the buffers
+// are kept between frames. The views are returned without ROI, a stage that sets one must reset it.
+class FrameImages {
+    public:
+        FrameImages();
+        ~FrameImages();
+
+    public:
+        // Starts a new frame (BGR), the views of the previous one aren't valid anymore. With the luma plane
+        // of the source the gray views come from it, without color conversion; then the frame can be 0
+        // if only gray views are asked for
+        void setFrame(IplImage *frame, IplImage *luma = 0);
+        IplImage *frame() const;
+        CvSize size() const;
+
+        // Gray views. The small ones are reduced by 'downscale'
+        IplImage *gray();
+        IplImage *smallGray(double downscale);
+        IplImage *equalized(double downscale);
+
+        // Gray reduced by an integer factor (an exact box filter, so any region matches the whole image), only
+        // calculated on the regions asked for on this frame (reduced coordinates). Kept apart from smallGray(),
+        // so a tracker doesn't change the downscale of the detection
+        IplImage *smallGray(int downscale, CvRect region);
+
+        // Color views, only calculated on the regions asked for on this frame
+        IplImage *hsv(CvRect region);
+        IplImage *hue(CvRect region);
+        IplImage *mask(CvRect region, int vMin, int vMax, int sMin);
+
+        // The whole frame reduced by an integer factor (nearest pixel) in HSV, for the skin filter
+        IplImage *smallHSV(int reduction);
+
+    private:
+        void updateImage(IplImage **image, CvSize size, int depth, int channels);
+        bool extendRegion(CvRect *valid, CvRect *region, CvSize size) const;
+        IplImage *gray(CvRect region);
+        void setDownscale(double downscale);
+
+    private:
+        IplImage *mFrame;
+        IplImage *mLuma;
+        IplImage *mGray, *mSmallGray, *mEqualized;
+        IplImage *mRegionSmallGray;
+        IplImage *mHSV, *mHue, *mMask;
+        IplImage *mSmallBGR, *mSmallHSV;
+
+        bool mGrayValid, mSmallGrayValid, mEqualizedValid, mSmallHSVValid;
+        double mDownscale;                      // Of the small gray and equalized images
+        int mReduction;                         // Of the small HSV image
+        int mRegionDownscale;                   // Of the small gray calculated by regions
+        CvRect mGrayRegionValid, mRegionSmallGrayValid;
+        CvRect mHSVValid, mHueValid, mMaskValid;    // Regions already calculated (empty if none)
+        int mMaskVMin, mMaskVMax, mMaskSMin;    // Thresholds of the calculated mask
+};
+
+#endif // FRAMEIMAGES_H
@@ -0,0 +1,476 @@
+/*  
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+ 
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include "framepipeline.h"
+
+#include <QFileInfo>
+#include <QMutexLocker>
+
+FrameResults::FrameResults() {
+    hasBox = false;
+    found = false;
+}
+
+PipelineProbe::~PipelineProbe() {
+}
+
+FramePipeline::FramePipeline(int cameraIndex) : QObject(), ProcessingStream() {
+    mCameraIndex = cameraIndex;
+    mSize = cvSize(0, 0);
+    mSynchronous = false;
+    mProbe = 0;
+
+    mVideoWriter = 0;
+    mRecordStart = -1;
+    mTrackLog = new TrackLog();
+    mEventRecorder = new EventRecorder();
+    mFrameExport = 0;
+
+    mQoS = new FrameQoS();
+    mFaceDetect = new FaceDetect();
+    mFaceDetect->setFlags(CV_HAAR_FIND_BIGGEST_OBJECT); // default
+    mDetectController = new DetectController();
+    mCamShift = 0;
+    mCamShiftVMin = mCamShiftSMin = 50;
+    mCamShiftMode = CamShift::FusedMode;
+    mCamShiftPrediction = true;
+    mFlowTracker = new FlowTracker();
+    mFrameImages = new FrameImages();
+    mDetectingFaces = false;
+    mTrackingFace = false;
+    mTracker = CamShiftTracker;
+    mAutoRecord = false;
+    mCvRect = cvRect(-1, -1, 0, 0);
+    mStartRect = false;
+    mTrackedFrames = 0;
+    mTrackId = mResultTrackId = -1;
+
+    mHasResultBox = mNewResult = false;
+    mResultCost = 0;
+}
+
+FramePipeline::~FramePipeline() {
+    // Wait for the workers before deleting what they use
+    stopProcessing();
+
+    if(mVideoWriter) cvReleaseVideoWriter(&mVideoWriter);
+    delete mTrackLog;
+    delete mEventRecorder;
+    if(mFrameExport) delete mFrameExport;
+    delete mQoS;
+    delete mFaceDetect;
+    delete mDetectController;
+    if(mCamShift) delete mCamShift;
+    delete mFlowTracker;
+    delete mFrameImages;
+}
+
+void FramePipeline::setFrameSize(CvSize size) {
+    QMutexLocker locker(&mProcessLock);
+    mSize = size;
+    if(mCamShift) delete mCamShift;
+    mCamShift = new CamShift(size);
+    mCamShift->setVMin(mCamShiftVMin);
+    mCamShift->setSMin(mCamShiftSMin);
+    mCamShift->setMode(mCamShiftMode);
+    mCamShift->setPrediction(mCamShiftPrediction);
+}
+
+CvSize FramePipeline::frameSize() const {
+    return mSize;
+}
+
+FrameQoS *FramePipeline::qos() const {
+    return mQoS;
+}
+
+// Tracking, the skin filter and the recordings need the color image, detection can work on the luma
+bool FramePipeline::needsColor() const {
+    QMutexLocker locker(&mProcessLock);
+    return mTrackingFace || mAutoRecord || mFaceDetect->isSkinFilterEnabled() || mVideoWriter || mFrameExport;
+}
+
+void FramePipeline::setSynchronous(bool synchronous) {
+    mSynchronous = synchronous;
+}
+
+void FramePipeline::setProbe(PipelineProbe *probe) {
+    mProbe = probe;
+}
+
+FrameTiming FramePipeline::feed(const Frame &frame, FrameResults *results) {
+    // Deadline of this frame from its delivery, late frames skip the optional stages
+    FrameTiming timing = mQoS->beginFrame(frame.info().timestamp);
+    const FrameInfo &frameInfo = frame.info();
+    IplImage *image = frameInfo.hasImage ? frame.image() : 0;
+
+    bool detecting, tracking, showRects, autoRecord, reportsLoss;
+    {
+        QMutexLocker locker(&mProcessLock);
+        showRects = mDetectingFaces;
+        detecting = mDetectingFaces || detectsForRecorder();
+        tracking = mTrackingFace;
+        reportsLoss = mTrackingFace && mTracker == OpticalFlowTracker;
+        autoRecord = mAutoRecord;
+    }
+
+    // Send the frame to the workers. Detection and tracking results come back on later frames
+    FrameQoS::Stage stage = detecting ? FrameQoS::Detection : FrameQoS::Tracking;
+    if((detecting || tracking) && mQoS->runStage(timing, stage)) {
+        submitFrame(frame);
+        if(mSynchronous) waitForIdle();
+    }
+
+    // Take the latest results (a job running when the mode was switched off could still leave some)
+    QVector<QRect> listRect;
+    CvBox2D box;
+    bool hasBox = false;
+    int trackId = -1;
+    if(detecting || tracking) {
+        QMutexLocker locker(&mResultLock);
+        if(mNewResult) mQoS->addCost(stage, mResultCost);
+        mNewResult = false;
+        listRect = mResultRects;
+        hasBox = mHasResultBox;
+        box = mResultBox;
+        trackId = mResultTrackId;
+    }
+
+    // Without the color image (a source with luma, when nothing needed it) the recordings skip the frame
+    if(mProbe) mProbe->stageStarted(Recording);
+
+    // The side-car log gets the results shown with each recorded frame (display coordinates)
+    if(mVideoWriter && image && mQoS->runStage(timing, FrameQoS::Recording)) {
+        cvWriteFrame(mVideoWriter, image);
+        int flips = (frameInfo.flipH ? TrackLogRecord::FlippedH : 0) | (frameInfo.flipV ? TrackLogRecord::FlippedV : 0);
+        if(mRecordStart < 0) mRecordStart = timing.captureTime;
+        mTrackLog->write(qint64((timing.captureTime - mRecordStart) * 1000), listRect, hasBox ? &box : 0, trackId, flips);
+        mQoS->endStage(FrameQoS::Recording);
+    }
+
+    // Other processes get the frame and its results from shared memory
+    if(mFrameExport && image) mFrameExport->publish(frame, listRect, hasBox ? &box : 0);
+
+    // A face starts an event recording (with the frames of the pre-roll), no faces for a while stops it. A CamShift
+    // box is there until the tracking is switched off, only detections and a flow track that can be lost count
+    if(autoRecord && image && mQoS->runStage(timing, FrameQoS::EventRecording)) {
+        if(mEventRecorder->addFrame(image, timing.captureTime, !listRect.isEmpty() || (reportsLoss && hasBox))) {
+            if(mEventRecorder->state() == EventRecorder::Recording) emit info("Recording event to " + mEventRecorder->fileName());
+            else if(mEventRecorder->dropped()) emit info(QString("Event recorded on %1, %2 frames dropped")
+                                                         .arg(mEventRecorder->fileName()).arg(mEventRecorder->dropped()));
+            else emit info("Event recorded on " + mEventRecorder->fileName());
+        }
+        mQoS->endStage(FrameQoS::EventRecording);
+    }
+
+    results->found = hasBox || !listRect.isEmpty();
+    results->hasBox = hasBox;
+    results->box = box;
+    // The faces detected only for the event recorder aren't drawn
+    if(showRects) results->faces = listRect;
+        else results->faces.clear();
+
+    return timing;
+}
+
+// Runs on a worker thread of the ProcessingPool
+void FramePipeline::processFrame(const Frame &frame) {
+    QMutexLocker locker(&mProcessLock);
+    double timeElapsed = (double)cvGetTickCount();
+    if(mProbe) mProbe->stageStarted(Detection);
+
+    QVector<QRect> listRect;
+    CvBox2D box;
+    bool hasBox = false;
+
+    // Gray, small, HSV... images of the frame are calculated once for all the stages below
+    mFrameImages->setFrame(frame.info().hasImage ? frame.image() : 0, frame.luma());
+
+    if(mDetectingFaces || detectsForRecorder()) listRect = detectFaces(mFrameImages);
+
+    if(mProbe) mProbe->stageStarted(Tracking);
+
+    // A frame captured before the tracking was switched on may not have the color image
+    if(mTrackingFace && frame.info().hasImage) {
+        // Check if we have a valid rect. If we have a valid one, we track the face,
+        // if not we get a face rect first
+        if(!(mCvRect.width > 0 && mCvRect.height > 0) || mStartRect) {
+            // Detect the Face, unless the rect was given
+            if(!mStartRect) {
+                QVector<QRect> trackList = detectFaces(mFrameImages);
+                if(!trackList.isEmpty()) {
+                    QRect trackRect = trackList.at(0);
+                    mCvRect = cvRect(trackRect.x(), trackRect.y(), trackRect.width(), trackRect.height());
+                }
+            }
+            mStartRect = false;
+
+            if(mCvRect.width > 0 && mCvRect.height > 0) {
+                if(mTracker == OpticalFlowTracker) {
+                    // Without features to follow we detect again on the next frame
+                    if(!mFlowTracker->startTracking(mFrameImages, mCvRect, mFaceDetect->params().downscale))
+                        mCvRect = cvRect(-1, -1, 0, 0);
+                } else mCamShift->startTracking(mFrameImages, mCvRect);
+
+                // A new track on the side-car log
+                if(mCvRect.width > 0 && mCvRect.height > 0) mTrackId++;
+            }
+        } else if(mTracker == OpticalFlowTracker) {
+            // Track the feature points, a lost face is detected again on the next frame
+            box = mFlowTracker->trackFace(mFrameImages);
+            hasBox = !mFlowTracker->isLost();
+            if(!hasBox) mCvRect = cvRect(-1, -1, 0, 0);
+
+            if(++mTrackedFrames % 32 == 0)
+                emit info(QString("Tracking: %1 points, %2% kept per frame, %3 ms per frame").arg(mFlowTracker->points())
+                          .arg(mFlowTracker->survival() * 100, 0, 'f', 1).arg(mFlowTracker->trackTime(), 0, 'f', 2));
+        } else {
+            // Track the Face
+            box = mCamShift->trackFace(mFrameImages);
+            hasBox = true;
+
+            if(++mTrackedFrames % 32 == 0)
+                emit info(QString("Tracking: %1 iterations, %2 ms per frame").arg(mCamShift->iterations(), 0, 'f', 1)
+                          .arg(mCamShift->trackTime(), 0, 'f', 2));
+        }
+    }
+
+    timeElapsed = ((double)cvGetTickCount() - timeElapsed)/((double)cvGetTickFrequency()*1000);
+
+    QMutexLocker resultLocker(&mResultLock);
+    mResultRects = listRect;
+    mResultBox = box;
+    mHasResultBox = hasBox;
+    mResultTrackId = mTrackId;
+    mResultCost = timeElapsed;
+    mNewResult = true;
+}
+
+// Detect the faces and adapt the detection parameters to the latency budget
+QVector<QRect> FramePipeline::detectFaces(FrameImages *images) {
+    QVector<QRect> listRect = mFaceDetect->detectFaces(images);
+
+    if(mDetectController->update(mFaceDetect->lastDetectTime())) {
+        DetectParams params = mDetectController->params();
+        mFaceDetect->setParams(params);
+        emit info(QString("Detection: %1 ms (downscale %2, step %3, min size %4)")
+                  .arg(mDetectController->averageTime(), 0, 'f', 1).arg(params.downscale, 0, 'f', 2)
+                  .arg(params.scaleFactor, 0, 'f', 2).arg(params.minSize));
+    }
+
+    return listRect;
+}
+
+// The event recorder needs faces that go away: unless the flow tracker (it reports a lost face) is tracking,
+// they're detected for it. Called with mProcessLock held
+bool FramePipeline::detectsForRecorder() const {
+    return mAutoRecord && !(mTrackingFace && mTracker == OpticalFlowTracker);
+}
+
+// The video and its side-car log (same name, .trk)
+bool FramePipeline::startRecording(const QString &filename) {
+    stopRecording();
+
+    // It seems that my camera don't get more than 8 fps at 640x480
+    mVideoWriter = cvCreateVideoWriter(filename.toUtf8(), CV_FOURCC('D','I','V','X'), 8, mSize);
+    if(!mVideoWriter) return false;
+
+    // Detections and tracks go to a side-car file with the same name
+    QFileInfo video(filename);
+    mTrackLog->open(video.path() + "/" + video.completeBaseName() + ".trk", mSize);
+    mRecordStart = -1;
+    return true;
+}
+
+void FramePipeline::stopRecording() {
+    if(mVideoWriter) cvReleaseVideoWriter(&mVideoWriter);
+    mTrackLog->close();
+}
+
+bool FramePipeline::isRecording() const {
+    return mVideoWriter || mEventRecorder->state() == EventRecorder::Recording;
+}
+
+// Record automatically when faces appear, starting some seconds before them
+void FramePipeline::setAutoRecord(bool enabled) {
+    {
+        QMutexLocker locker(&mProcessLock);
+        mAutoRecord = enabled;
+    }
+    if(!enabled) mEventRecorder->stop();
+}
+
+bool FramePipeline::isAutoRecord() const {
+    QMutexLocker locker(&mProcessLock);
+    return mAutoRecord;
+}
+
+void FramePipeline::setAutoRecordTimes(double preRoll, double timeout) {
+    mEventRecorder->setPreRoll(preRoll);
+    mEventRecorder->setTimeout(timeout);
+}
+
+// Publish the frames and results on shared memory (FrameExport::key() of the camera index)
+bool FramePipeline::setExport(bool enabled) {
+    if(enabled && !mFrameExport) {
+        mFrameExport = new FrameExport();
+        if(mFrameExport->open(mCameraIndex, mSize)) {
+            emit info("Sharing frames on " + FrameExport::key(mCameraIndex));
+        } else {
+            emit info("Can't share frames: " + mFrameExport->errorString());
+            delete mFrameExport;
+            mFrameExport = 0;
+        }
+    } else if(!enabled && mFrameExport) {
+        delete mFrameExport;
+        mFrameExport = 0;
+    }
+    return bool(mFrameExport) == enabled;
+}
+
+bool FramePipeline::isExportEnabled() const {
+    return bool(mFrameExport);
+}
+
+// The settings are shared with the workers, so they're changed with mProcessLock held
+void FramePipeline::setDetectFaces(bool detect) {
+    QMutexLocker locker(&mProcessLock);
+    mDetectingFaces = detect;
+    if(!detect) clearResults();
+}
+
+// CamShift follows the face color, the optical flow tracker follows feature points of the face.
+// Changing the tracker starts again from a detection
+void FramePipeline::setTrackFace(bool track, Tracker tracker) {
+    QMutexLocker locker(&mProcessLock);
+    mTrackingFace = track;
+    if(!mTrackingFace || tracker != mTracker) {
+        mCvRect = cvRect(-1, -1, 0, 0);
+        mStartRect = false;
+        clearResults();
+    }
+    if(mTrackingFace) mTracker = tracker;
+}
+
+FramePipeline::Tracker FramePipeline::tracker() const {
+    QMutexLocker locker(&mProcessLock);
+    return mTracker;
+}
+
+void FramePipeline::startTracking(CvRect rect) {
+    QMutexLocker locker(&mProcessLock);
+    mCvRect = rect;
+    mStartRect = true;
+}
+
+void FramePipeline::clearResults() {
+    QMutexLocker locker(&mResultLock);
+    mResultRects.clear();
+    mHasResultBox = false;
+}
+
+void FramePipeline::setFaceDetectFlags(int flags) {
+    QMutexLocker locker(&mProcessLock);
+    mFaceDetect->setFlags(flags);
+}
+
+// Only search faces in the skin colored regions. The filter shares the vMin/sMin thresholds with CamShift
+void FramePipeline::setSkinFilter(bool enabled) {
+    QMutexLocker locker(&mProcessLock);
+    mFaceDetect->setSkinFilter(enabled);
+}
+
+bool FramePipeline::isSkinFilterEnabled() const {
+    QMutexLocker locker(&mProcessLock);
+    return mFaceDetect->isSkinFilterEnabled();
+}
+
+// Target milliseconds per detection, 0 goes back to the default parameters
+void FramePipeline::setDetectBudget(double ms) {
+    QMutexLocker locker(&mProcessLock);
+    mDetectController->setBudget(ms);
+    mFaceDetect->setParams(mDetectController->params());
+}
+
+double FramePipeline::detectBudget() const {
+    QMutexLocker locker(&mProcessLock);
+    return mDetectController->budget();
+}
+
+DetectParams FramePipeline::detectParams() const {
+    QMutexLocker locker(&mProcessLock);
+    return mFaceDetect->params();
+}
+
+void FramePipeline::setCascadeFile(const QString &filename) {
+    QMutexLocker locker(&mProcessLock);
+    mFaceDetect->setCascadeFile(filename);
+}
+
+QString FramePipeline::cascadeFile() const {
+    QMutexLocker locker(&mProcessLock);
+    return mFaceDetect->cascadeFile();
+}
+
+// The CamShift settings are kept until setFrameSize() creates it
+void FramePipeline::setCamShiftVMin(int vMin) {
+    QMutexLocker locker(&mProcessLock);
+    mCamShiftVMin = vMin;
+    if(mCamShift) mCamShift->setVMin(vMin);
+    mFaceDetect->skinFilter()->setVMin(vMin);
+}
+
+void FramePipeline::setCamShiftSMin(int sMin) {
+    QMutexLocker locker(&mProcessLock);
+    mCamShiftSMin = sMin;
+    if(mCamShift) mCamShift->setSMin(sMin);
+    mFaceDetect->skinFilter()->setSMin(sMin);
+}
+
+int FramePipeline::camshiftVMin() const {
+    QMutexLocker locker(&mProcessLock);
+    return mCamShiftVMin;
+}
+
+int FramePipeline::camshiftSMin() const {
+    QMutexLocker locker(&mProcessLock);
+    return mCamShiftSMin;
+}
+
+// How CamShift calculates the face probability (reference, fused or quantized BGR table)
+void FramePipeline::setCamShiftMode(CamShift::Mode mode) {
+    QMutexLocker locker(&mProcessLock);
+    mCamShiftMode = mode;
+    if(mCamShift) mCamShift->setMode(mode);
+}
+
+CamShift::Mode FramePipeline::camshiftMode() const {
+    QMutexLocker locker(&mProcessLock);
+    return mCamShiftMode;
+}
+
+void FramePipeline::setCamShiftPrediction(bool prediction) {
+    QMutexLocker locker(&mProcessLock);
+    mCamShiftPrediction = prediction;
+    if(mCamShift) mCamShift->setPrediction(prediction);
+}
+
+bool FramePipeline::camshiftPrediction() const {
+    QMutexLocker locker(&mProcessLock);
+    return mCamShiftPrediction;
+}
@@ -0,0 +1,173 @@
+/*  
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+ 
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef FRAMEPIPELINE_H
+#define FRAMEPIPELINE_H
+
+#include <QObject>
+#include <QMutex>
+#include <QRect>
+#include <QString>
+#include <QVector>
+
+#include "cv.h"
+#include "highgui.h"
+
+#include "frame.h"
+#include "frameimages.h"
+#include "facedetect.h"
+#include "detectcontroller.h"
+#include "frameqos.h"
+#include "camshift.h"
+#include "flowtracker.h"
+#include "processingpool.h"
+#include "eventrecorder.h"
+#include "tracklog.h"
+#include "frameexport.h"
+
+// What the pipeline has for a frame: the latest results of the workers
+struct FrameResults {
+    FrameResults();
+
+    QVector<QRect> faces;       // Only if the detection is shown (the faces searched for the event recorder aren't)
+    CvBox2D box;
+    bool hasBox;
+    bool found;                 // There were faces or a track, shown or not
+};
+
+// Sees the stages of each frame start (the allocation check and the replay benchmark). Detection and
+// tracking are reported from the worker thread, so the stages only follow each other in synchronous mode
+class PipelineProbe {
+    public:
+        virtual ~PipelineProbe();
+        virtual void stageStarted(int stage) = 0;
+};
+
+// The work done on the frames of a camera, whoever captures them: they're handed to the shared
+// ProcessingPool for detection and tracking, and the latest results of the workers are recorded,
+// exported and returned to be drawn. OpenCVWidget feeds it from the capture thread, --alloc-check and
+// --replay from their sources.
+class FramePipeline : public QObject, public ProcessingStream {
+    Q_OBJECT
+
+    signals:
+        void info(const QString &str);
+
+    public:
+        enum Tracker { CamShiftTracker, OpticalFlowTracker };
+        enum Stage { Detection, Tracking, Recording, StageCount };
+
+        FramePipeline(int cameraIndex = 0);
+        ~FramePipeline();
+
+    public:
+        // Creates the objects that depend on the frame size, before the first frame
+        void setFrameSize(CvSize size);
+        CvSize frameSize() const;
+
+        // Runs the stages of a frame and returns its timing; close it with qos()->endFrame() once it's shown
+        FrameTiming feed(const Frame &frame, FrameResults *results);
+        FrameQoS *qos() const;
+        bool needsColor() const;            // Some stage uses the color image, not only the luma
+
+        // Wait for the workers on each frame, so the results are those of the frame itself (benchmarks)
+        void setSynchronous(bool synchronous);
+        void setProbe(PipelineProbe *probe);
+
+        bool startRecording(const QString &filename);
+        void stopRecording();
+        bool isRecording() const;           // A video or an event is being recorded
+        void setAutoRecord(bool enabled);
+        bool isAutoRecord() const;
+        void setAutoRecordTimes(double preRoll, double timeout);
+        bool setExport(bool enabled);
+        bool isExportEnabled() const;
+
+        void setDetectFaces(bool detect);
+        void setTrackFace(bool track, Tracker tracker = CamShiftTracker);
+        Tracker tracker() const;
+        void startTracking(CvRect rect);    // Track from this rect instead of a detection
+        void setFaceDetectFlags(int flags);
+        void setSkinFilter(bool enabled);
+        bool isSkinFilterEnabled() const;
+        void setDetectBudget(double ms);
+        double detectBudget() const;
+        DetectParams detectParams() const;
+        void setCascadeFile(const QString &filename);
+        QString cascadeFile() const;
+
+        void setCamShiftVMin(int vMin);
+        void setCamShiftSMin(int sMin);
+        int camshiftVMin() const;
+        int camshiftSMin() const;
+        void setCamShiftMode(CamShift::Mode mode);
+        CamShift::Mode camshiftMode() const;
+        void setCamShiftPrediction(bool prediction);
+        bool camshiftPrediction() const;
+
+    protected:
+        void processFrame(const Frame &frame);
+
+    private:
+        QVector<QRect> detectFaces(FrameImages *images);
+        bool detectsForRecorder() const;
+        void clearResults();
+
+    private:
+        int mCameraIndex;
+        CvSize mSize;
+        FrameQoS *mQoS;
+        bool mSynchronous;
+        PipelineProbe *mProbe;
+
+        CvVideoWriter *mVideoWriter;
+        TrackLog *mTrackLog;        // Side-car of the video being written
+        double mRecordStart;        // Capture time of the first recorded frame, -1 before it
+        EventRecorder *mEventRecorder;
+        FrameExport *mFrameExport;  // Shared memory for other processes (0 if disabled)
+
+        // Detection/tracking state and settings, used by the workers
+        mutable QMutex mProcessLock;
+        FaceDetect *mFaceDetect;
+        DetectController *mDetectController;
+        CamShift *mCamShift;        // Created by setFrameSize()
+        int mCamShiftVMin, mCamShiftSMin;  // Settings kept for the CamShift of each frame size
+        CamShift::Mode mCamShiftMode;
+        bool mCamShiftPrediction;
+        FlowTracker *mFlowTracker;
+        FrameImages *mFrameImages;  // Derived images of the frame being processed
+        bool mDetectingFaces;
+        bool mTrackingFace;
+        Tracker mTracker;
+        bool mAutoRecord;           // Detect faces to start/stop the event recorder
+        CvRect mCvRect;
+        bool mStartRect;            // mCvRect was given by startTracking()
+        int mTrackedFrames;
+        int mTrackId;               // Incremented on every start of the tracker
+
+        // Latest results of the workers
+        QMutex mResultLock;
+        QVector<QRect> mResultRects;
+        CvBox2D mResultBox;
+        bool mHasResultBox;
+        int mResultTrackId;
+        bool mNewResult;
+        double mResultCost;
+};
+
+#endif // FRAMEPIPELINE_H
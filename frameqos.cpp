@@ -0,0 +1,126 @@
+/*
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include "frameqos.h"
+
+FrameQoS::FrameQoS() {
+    mEnabled = false;
+    mPeriod = 1000/16;
+    mSequence = 0;
+    mStageStart = 0;
+
+    // Default priority policy: keep the video complete, then the tracking state, and drop detection and overlay first
+    mTolerance[Recording] = 1.0;
+    mTolerance[EventRecording] = 1.0;
+    mTolerance[Tracking] = 0.5;
+    mTolerance[Detection] = 0.0;
+    mTolerance[Overlay] = 0.0;
+
+    for(int i = 0; i < StageCount; i++) mCost[i] = 0;
+    resetStatistics();
+}
+
+void FrameQoS::setEnabled(bool enabled) {
+    mEnabled = enabled;
+    resetStatistics();
+}
+
+bool FrameQoS::isEnabled() const {
+    return mEnabled;
+}
+
+void FrameQoS::setPeriod(double ms) {
+    mPeriod = ms;
+}
+
+void FrameQoS::setTolerance(Stage stage, double periods) {
+    mTolerance[stage] = periods;
+}
+
+// Milliseconds from an arbitrary origin
+double FrameQoS::now() {
+    return (double)cvGetTickCount()/((double)cvGetTickFrequency()*1000);
+}
+
+// A frame that arrives after its deadline is already late: its optional stages are skipped
+FrameTiming FrameQoS::beginFrame(double captureTime) {
+    FrameTiming timing;
+    timing.sequence = mSequence++;
+    timing.captureTime = captureTime;
+    timing.deadline = timing.captureTime + mPeriod;
+    return timing;
+}
+
+void FrameQoS::endFrame(const FrameTiming &timing) {
+    double latency = now() - timing.captureTime;
+    mFrames++;
+    mLatencySum += latency;
+    if(latency > mMaxLatency) mMaxLatency = latency;
+}
+
+// A stage runs if it's expected to finish before the deadline plus the lateness its priority accepts
+bool FrameQoS::runStage(const FrameTiming &timing, Stage stage) {
+    mStageStart = now();
+    if(!mEnabled) return true;
+
+    if(mStageStart + mCost[stage] > timing.deadline + mTolerance[stage] * mPeriod) {
+        // Forget the cost slowly, a single expensive run mustn't disable the stage forever
+        mCost[stage] *= 0.9;
+        mSkipped[stage]++;
+        return false;
+    }
+    return true;
+}
+
+void FrameQoS::endStage(Stage stage) {
+    addCost(stage, now() - mStageStart);
+}
+
+void FrameQoS::addCost(Stage stage, double ms) {
+    mCost[stage] = mCost[stage] ? 0.8 * mCost[stage] + 0.2 * ms : ms;
+}
+
+qint64 FrameQoS::frames() const {
+    return mFrames;
+}
+
+qint64 FrameQoS::skipped(Stage stage) const {
+    return mSkipped[stage];
+}
+
+double FrameQoS::averageLatency() const {
+    return mFrames ? mLatencySum / mFrames : 0;
+}
+
+double FrameQoS::maxLatency() const {
+    return mMaxLatency;
+}
+
+QString FrameQoS::report() const {
+    return QString("QoS: latency %1/%2 ms, skipped rec %3, event %4, track %5, detect %6, overlay %7 of %8 frames")
+            .arg(averageLatency(), 0, 'f', 1).arg(maxLatency(), 0, 'f', 1)
+            .arg(mSkipped[Recording]).arg(mSkipped[EventRecording]).arg(mSkipped[Tracking]).arg(mSkipped[Detection])
+            .arg(mSkipped[Overlay]).arg(mFrames);
+}
+
+void FrameQoS::resetStatistics() {
+    for(int i = 0; i < StageCount; i++) mSkipped[i] = 0;
+    mFrames = 0;
+    mLatencySum = 0;
+    mMaxLatency = 0;
+}
@@ -0,0 +1,84 @@
+/*
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef FRAMEQOS_H
+#define FRAMEQOS_H
+
+#include <QString>
+
+#include "cv.h"
+
+// Capture time and deadline of a frame (milliseconds)
+struct FrameTiming {
+    qint64 sequence;
+    double captureTime;         // When the driver delivered the frame
+    double deadline;
+};
+
+// Quality of service for the processing loop.
+// Every frame gets a deadline (capture time + frame period) and the optional stages ask before running
+// if the frame can still afford them. Each stage tolerates some lateness according to its priority,
+// so under overload the least important work is dropped first and the latency stays bounded.
+class FrameQoS {
+    public:
+        enum Stage { Recording, EventRecording, Tracking, Detection, Overlay, StageCount };
+
+        FrameQoS();
+
+    public:
+        void setEnabled(bool enabled);
+        bool isEnabled() const;
+        void setPeriod(double ms);
+        void setTolerance(Stage stage, double periods);    // Lateness accepted by the stage, in frame periods
+
+        // Call with the time the frame was delivered (so only the processing makes it late), and when it's
+        // ready to display
+        FrameTiming beginFrame(double captureTime);
+        void endFrame(const FrameTiming &timing);
+
+        // runStage() returns false if the stage must be skipped, endStage() measures the stage cost
+        bool runStage(const FrameTiming &timing, Stage stage);
+        void endStage(Stage stage);
+        void addCost(Stage stage, double ms);      // For the stages measured elsewhere (the workers)
+
+        // Statistics
+        qint64 frames() const;
+        qint64 skipped(Stage stage) const;
+        double averageLatency() const;
+        double maxLatency() const;
+        QString report() const;
+        void resetStatistics();
+
+        static double now();
+
+    private:
+        bool mEnabled;
+        double mPeriod;
+        qint64 mSequence;
+
+        double mTolerance[StageCount];
+        double mCost[StageCount];           // Smoothed cost of each stage
+        qint64 mSkipped[StageCount];
+        double mStageStart;
+
+        qint64 mFrames;
+        double mLatencySum;
+        double mMaxLatency;
+};
+
+#endif // FRAMEQOS_H
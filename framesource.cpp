@@ -0,0 +1,197 @@
+/*
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include "framesource.h"
+
+#include <math.h>
+
+FrameSource::FrameSource() {
+    mGrabbed = 0;
+}
+
+FrameSource::~FrameSource() {
+}
+
+bool FrameSource::grabFrame() {
+    mGrabbed = queryFrame();
+    return bool(mGrabbed);
+}
+
+IplImage *FrameSource::retrieveFrame() {
+    return mGrabbed;
+}
+
+IplImage *FrameSource::retrieveLuma() {
+    return 0;
+}
+
+
+CameraSource::CameraSource(int index) {
+    mCapture = cvCaptureFromCAM(index);
+}
+
+CameraSource::~CameraSource() {
+    if(mCapture) cvReleaseCapture(&mCapture);
+}
+
+bool CameraSource::isOpen() const {
+    return bool(mCapture);
+}
+
+IplImage *CameraSource::queryFrame() {
+    return mCapture ? cvQueryFrame(mCapture) : 0;
+}
+
+bool CameraSource::grabFrame() {
+    return mCapture && cvGrabFrame(mCapture);
+}
+
+IplImage *CameraSource::retrieveFrame() {
+    return mCapture ? cvRetrieveFrame(mCapture) : 0;
+}
+
+
+SyntheticSource::SyntheticSource(CvSize size) {
+    mFrame = 0;
+    mFaceRect = cvRect(0, 0, 0, 0);
+    mImage = cvCreateImage(size, 8, 3);
+    mBackground = cvCreateImage(size, 8, 3);
+
+    // Gray gradient with a grid, so the background has some edges but no skin colors
+    for(int y = 0; y < size.height; y++) {
+        uchar *pixel = (uchar *)(mBackground->imageData + y * mBackground->widthStep);
+        for(int x = 0; x < size.width; x++, pixel += 3)
+            pixel[0] = pixel[1] = pixel[2] = (uchar)(64 + 96 * x / size.width + 32 * y / size.height);
+    }
+    for(int x = 0; x < size.width; x += 40) cvLine(mBackground, cvPoint(x, 0), cvPoint(x, size.height), CV_RGB(40,40,40), 1, 8, 0);
+    for(int y = 0; y < size.height; y += 40) cvLine(mBackground, cvPoint(0, y), cvPoint(size.width, y), CV_RGB(40,40,40), 1, 8, 0);
+}
+
+SyntheticSource::~SyntheticSource() {
+    cvReleaseImage(&mImage);
+    cvReleaseImage(&mBackground);
+}
+
+bool SyntheticSource::isOpen() const {
+    return true;
+}
+
+IplImage *SyntheticSource::queryFrame() {
+    int width = mImage->width, height = mImage->height;
+    int faceWidth = width / 5, faceHeight = faceWidth * 4 / 3;
+    CvPoint center = cvPoint(cvRound(width * (0.5 + 0.25 * sin(mFrame * 0.05))),
+                             cvRound(height * (0.5 + 0.15 * sin(mFrame * 0.07))));
+
+    cvCopy(mBackground, mImage, 0);
+
+    cvEllipse(mImage, center, cvSize(faceWidth / 2, faceHeight / 2), 0, 0, 360, CV_RGB(224,172,140), -1, 8, 0);
+    cvCircle(mImage, cvPoint(center.x - faceWidth / 5, center.y - faceHeight / 8), faceWidth / 12, CV_RGB(40,30,30), -1, 8, 0);
+    cvCircle(mImage, cvPoint(center.x + faceWidth / 5, center.y - faceHeight / 8), faceWidth / 12, CV_RGB(40,30,30), -1, 8, 0);
+    cvEllipse(mImage, cvPoint(center.x, center.y + faceHeight / 4), cvSize(faceWidth / 5, faceHeight / 16), 0, 0, 180,
+              CV_RGB(150,60,60), -1, 8, 0);
+
+    mFaceRect = cvRect(center.x - faceWidth / 2, center.y - faceHeight / 2, faceWidth, faceHeight);
+    mFrame++;
+
+    return mImage;
+}
+
+CvRect SyntheticSource::faceRect() const {
+    return mFaceRect;
+}
+
+
+YuyvSource::YuyvSource(CvSize size) : mPattern(size) {
+    mYuyv = cvCreateImage(size, 8, 2);
+    mLuma = cvCreateImage(size, 8, 1);
+    mBgr = cvCreateImage(size, 8, 3);
+    mBgrValid = mLumaValid = false;
+}
+
+YuyvSource::~YuyvSource() {
+    cvReleaseImage(&mYuyv);
+    cvReleaseImage(&mLuma);
+    cvReleaseImage(&mBgr);
+}
+
+bool YuyvSource::isOpen() const {
+    return true;
+}
+
+IplImage *YuyvSource::queryFrame() {
+    return grabFrame() ? retrieveFrame() : 0;
+}
+
+// What the camera would deliver: the pattern in YUYV (BT.601, integer)
+bool YuyvSource::grabFrame() {
+    IplImage *pattern = mPattern.queryFrame();
+
+    for(int y = 0; y < pattern->height; y++) {
+        const uchar *bgr = (const uchar *)(pattern->imageData + y * pattern->widthStep);
+        uchar *yuyv = (uchar *)(mYuyv->imageData + y * mYuyv->widthStep);
+
+        for(int x = 0; x + 1 < pattern->width; x += 2, bgr += 6, yuyv += 4) {
+            int y0 = (66 * bgr[2] + 129 * bgr[1] + 25 * bgr[0] + 128) >> 8;
+            int y1 = (66 * bgr[5] + 129 * bgr[4] + 25 * bgr[3] + 128) >> 8;
+            int b = (bgr[0] + bgr[3]) / 2, g = (bgr[1] + bgr[4]) / 2, r = (bgr[2] + bgr[5]) / 2;
+            yuyv[0] = (uchar)(y0 + 16);
+            yuyv[1] = (uchar)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+            yuyv[2] = (uchar)(y1 + 16);
+            yuyv[3] = (uchar)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+        }
+    }
+
+    mBgrValid = mLumaValid = false;
+    return true;
+}
+
+IplImage *YuyvSource::retrieveFrame() {
+    if(mBgrValid) return mBgr;
+
+    for(int y = 0; y < mYuyv->height; y++) {
+        const uchar *yuyv = (const uchar *)(mYuyv->imageData + y * mYuyv->widthStep);
+        uchar *bgr = (uchar *)(mBgr->imageData + y * mBgr->widthStep);
+
+        for(int x = 0; x + 1 < mYuyv->width; x += 2, yuyv += 4, bgr += 6) {
+            int u = yuyv[1] - 128, v = yuyv[3] - 128;
+            for(int i = 0; i < 2; i++) {
+                int c = 298 * (yuyv[i * 2] - 16);
+                bgr[i * 3] = CV_CAST_8U((c + 516 * u + 128) >> 8);
+                bgr[i * 3 + 1] = CV_CAST_8U((c - 100 * u - 208 * v + 128) >> 8);
+                bgr[i * 3 + 2] = CV_CAST_8U((c + 409 * v + 128) >> 8);
+            }
+        }
+    }
+
+    mBgrValid = true;
+    return mBgr;
+}
+
+// The Y samples are the first channel of the YUYV image (video range, the detection equalizes it anyway)
+IplImage *YuyvSource::retrieveLuma() {
+    if(!mLumaValid) {
+        cvSplit(mYuyv, mLuma, 0, 0, 0);
+        mLumaValid = true;
+    }
+
+    return mLuma;
+}
+
+CvRect YuyvSource::faceRect() const {
+    return mPattern.faceRect();
+}
@@ -0,0 +1,110 @@
+/*
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef FRAMESOURCE_H
+#define FRAMESOURCE_H
+
+#include "cv.h"
+#include "highgui.h"
+
+// Where the frames come from. Like cvQueryFrame, the image returned belongs to the source
+// and it's valid until the next call.
+// Like cvGrabFrame/cvRetrieveFrame, a frame can also be grabbed first and converted later: retrieveFrame()
+// gives it in BGR, retrieveLuma() its luma plane when the source has it natively (YUV cameras), so the
+// gray images don't need any color conversion and the BGR one is only made if something asks for it
+class FrameSource {
+    public:
+        FrameSource();
+        virtual ~FrameSource();
+
+    public:
+        virtual bool isOpen() const = 0;
+        virtual IplImage *queryFrame() = 0;
+
+        virtual bool grabFrame();
+        virtual IplImage *retrieveFrame();
+        virtual IplImage *retrieveLuma();       // 0 if the source doesn't have it
+
+    private:
+        IplImage *mGrabbed;
+};
+
+class CameraSource : public FrameSource {
+    public:
+        CameraSource(int index = CV_CAP_ANY);
+        ~CameraSource();
+
+    public:
+        bool isOpen() const;
+        IplImage *queryFrame();
+
+        // highgui decodes and converts the frame on cvRetrieveFrame. It only gives BGR, so there isn't luma
+        bool grabFrame();
+        IplImage *retrieveFrame();
+
+    private:
+        CvCapture *mCapture;
+};
+
+// Deterministic test pattern, a skin colored face (eyes and mouth included) moving over a textured
+// background. Used to exercise the frame loop without a camera
+class SyntheticSource : public FrameSource {
+    public:
+        SyntheticSource(CvSize size = cvSize(640, 480));
+        ~SyntheticSource();
+
+    public:
+        bool isOpen() const;
+        IplImage *queryFrame();
+
+        // Bounding rect of the face on the last frame
+        CvRect faceRect() const;
+
+    private:
+        IplImage *mBackground;
+        IplImage *mImage;
+        CvRect mFaceRect;
+        int mFrame;
+};
+
+// The test pattern of SyntheticSource packed as YUYV (4:2:2, Y0 U Y1 V), like the native buffers of
+// most webcams. The luma is split from it without color math and the BGR frame is converted on demand
+class YuyvSource : public FrameSource {
+    public:
+        YuyvSource(CvSize size = cvSize(640, 480));
+        ~YuyvSource();
+
+    public:
+        bool isOpen() const;
+        IplImage *queryFrame();
+
+        bool grabFrame();
+        IplImage *retrieveFrame();
+        IplImage *retrieveLuma();
+
+        CvRect faceRect() const;
+
+    private:
+        SyntheticSource mPattern;
+        IplImage *mYuyv;            // 2 channels: Y, and U or V
+        IplImage *mLuma;
+        IplImage *mBgr;
+        bool mBgrValid, mLumaValid;
+};
+
+#endif // FRAMESOURCE_H
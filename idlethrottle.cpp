@@ -0,0 +1,136 @@
+/*
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include "idlethrottle.h"
+
+#include "frameqos.h"
+
+IdleThrottle::IdleThrottle() {
+    mEnabled = false;
+    mActivePeriod = 1000/16;
+    mIdlePeriod = 1000/4;
+    mIdleDelay = 3000;
+    mThreshold = 4;
+
+    mThumbnail = cvCreateImage(cvSize(32, 24), 8, 3);
+    mThumbnailGray = cvCreateImage(cvSize(32, 24), 8, 1);
+    mPrevThumbnail = cvCreateImage(cvSize(32, 24), 8, 1);
+    mHasPrevious = false;
+
+    mIdle = false;
+    mLastActive = 0;
+    resetStatistics();
+}
+
+IdleThrottle::~IdleThrottle() {
+    cvReleaseImage(&mThumbnail);
+    cvReleaseImage(&mThumbnailGray);
+    cvReleaseImage(&mPrevThumbnail);
+}
+
+// Disabled it's always active
+void IdleThrottle::setEnabled(bool enabled) {
+    mEnabled = enabled;
+    mIdle = false;
+    mHasPrevious = false;
+    mLastActive = FrameQoS::now();
+    resetStatistics();
+}
+
+bool IdleThrottle::isEnabled() const {
+    return mEnabled;
+}
+
+void IdleThrottle::setPeriods(double activePeriod, double idlePeriod) {
+    mActivePeriod = activePeriod;
+    mIdlePeriod = qMax(activePeriod, idlePeriod);
+}
+
+void IdleThrottle::setIdleDelay(double ms) {
+    mIdleDelay = ms;
+}
+
+void IdleThrottle::setThreshold(double meanDifference) {
+    mThreshold = meanDifference;
+}
+
+// The thumbnail is reduced by area, so the sensor noise averages out and only real changes count
+bool IdleThrottle::sceneChanged(const IplImage *image) {
+    if(!mEnabled) return true;
+
+    if(image->nChannels == 3) {
+        cvResize(image, mThumbnail, CV_INTER_AREA);
+        cvCvtColor(mThumbnail, mThumbnailGray, CV_BGR2GRAY);
+    } else cvResize(image, mThumbnailGray, CV_INTER_AREA);
+
+    bool changed = !mHasPrevious
+                   || cvNorm(mThumbnailGray, mPrevThumbnail, CV_L1) / (32 * 24) > mThreshold;
+    cvCopy(mThumbnailGray, mPrevThumbnail, 0);
+    mHasPrevious = true;
+
+    return changed;
+}
+
+bool IdleThrottle::update(double time, bool active) {
+    if(mLastUpdate > 0 && mIdle) mIdleTime += time - mLastUpdate;
+    mLastUpdate = time;
+    mFrames++;
+    if(mIdle) mIdleFrames++;
+
+    if(!mEnabled) return false;
+
+    bool wasIdle = mIdle;
+    if(active) {
+        mLastActive = time;
+        mIdle = false;
+    } else if(time - mLastActive >= mIdleDelay) mIdle = true;
+
+    return mIdle != wasIdle;
+}
+
+bool IdleThrottle::isIdle() const {
+    return mIdle;
+}
+
+double IdleThrottle::period() const {
+    return mIdle ? mIdlePeriod : mActivePeriod;
+}
+
+void IdleThrottle::addWork(double ms) {
+    mWork += ms;
+}
+
+void IdleThrottle::skipRepaint() {
+    mSkippedRepaints++;
+}
+
+// Duty cycle: share of the wall time the frame loop and its workers were working (of one core)
+QString IdleThrottle::report() const {
+    double elapsed = qMax(1.0, FrameQoS::now() - mStart);
+    return QString("%1, idle %2% of the time (%3 of %4 frames), duty cycle %5%, %6 repaints skipped")
+            .arg(mIdle ? "idle" : "active").arg(100 * mIdleTime / elapsed, 0, 'f', 0).arg(mIdleFrames).arg(mFrames)
+            .arg(100 * mWork / elapsed, 0, 'f', 1).arg(mSkippedRepaints);
+}
+
+void IdleThrottle::resetStatistics() {
+    mStart = FrameQoS::now();
+    mLastUpdate = 0;
+    mIdleTime = 0;
+    mWork = 0;
+    mFrames = mIdleFrames = mSkippedRepaints = 0;
+}
@@ -0,0 +1,75 @@
+/*
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef IDLETHROTTLE_H
+#define IDLETHROTTLE_H
+
+#include <QString>
+
+#include "cv.h"
+
+// Lowers the capture rate of a camera while nothing happens.
+// A frame is active if there are faces (detected or tracked) or the scene changed: the mean difference of a
+// 32x24 thumbnail against the previous frame is over the threshold. After 'idleDelay' ms without active frames
+// the camera goes idle (longer period, unchanged frames aren't repainted); the first active frame brings
+// back the full rate. A camera that is being recorded counts as active.
+class IdleThrottle {
+    public:
+        IdleThrottle();
+        ~IdleThrottle();
+
+    public:
+        void setEnabled(bool enabled);
+        bool isEnabled() const;
+        void setPeriods(double activePeriod, double idlePeriod);
+        void setIdleDelay(double ms);
+        void setThreshold(double meanDifference);
+
+        // Call for each frame: sceneChanged() with the frame (BGR or gray), update() with the result and the
+        // faces. update() returns true if the camera switched between active and idle
+        bool sceneChanged(const IplImage *image);
+        bool update(double time, bool active);
+        bool isIdle() const;
+        double period() const;              // The one the capture timer must use now
+
+        // Duty cycle statistics: the work of each frame (milliseconds, on the GUI thread and the workers) and the
+        // repaints skipped
+        void addWork(double ms);
+        void skipRepaint();
+        QString report() const;
+        void resetStatistics();
+
+    private:
+        bool mEnabled;
+        double mActivePeriod, mIdlePeriod;
+        double mIdleDelay;
+        double mThreshold;
+
+        IplImage *mThumbnail, *mPrevThumbnail, *mThumbnailGray;
+        bool mHasPrevious;
+
+        bool mIdle;
+        double mLastActive;
+
+        double mStart, mLastUpdate;
+        double mIdleTime;                   // Time spent idle since the statistics started
+        double mWork;                       // Milliseconds of frame work since the statistics started
+        qint64 mFrames, mIdleFrames, mSkippedRepaints;
+};
+
+#endif // IDLETHROTTLE_H
@@ -0,0 +1,78 @@
+/*
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include "kernelcheck.h"
+
+#include <QVector>
+
+KernelCheck::KernelCheck() {
+    mMismatches = 0;
+}
+
+bool KernelCheck::run(int rows) {
+    mLines.clear();
+    mMismatches = 0;
+
+    // Fixed seed, the same rows on every run
+    qsrand(1);
+    QVector<uchar> prob;
+
+    for(int level = CpuDispatch::SSE2; level < CpuDispatch::LevelCount; level++) {
+        const VisionKernels *kernels = CpuDispatch::kernels(CpuDispatch::Level(level));
+        QString name = CpuDispatch::levelName(CpuDispatch::Level(level));
+        if(!kernels) {
+            mLines << name + ": not supported, skipped";
+            continue;
+        }
+
+        int mismatches = 0;
+        for(int row = 0; row < rows; row++) {
+            // Short rows cover all the tails, long ones the accumulators (up to a 2048 pixels window, and some
+            // rows wider than any frame, where sum(p * x) needs 64 bits)
+            int width = row < 64 ? row : row % 16 == 0 ? 8192 + qrand() % 8193 : qrand() % 2049;
+            int fill = row % 4;
+            prob.resize(width);
+            for(int x = 0; x < width; x++)
+                prob[x] = (uchar)(fill == 0 ? qrand() % 256 : fill == 1 ? 255 : fill == 2 ? 0 : (qrand() % 8 ? 0 : qrand() % 256));
+
+            RowMoments reference, moments;
+            rowMomentsScalar(prob.constData(), width, &reference);
+            kernels->rowMoments(prob.constData(), width, &moments);
+
+            if(moments.sum0 != reference.sum0 || moments.sum1 != reference.sum1 || moments.sum2 != reference.sum2) {
+                if(mismatches++ < 4)
+                    mLines << QString("%1: rowMoments differs on a %2 pixels row (%3, %4, %5 instead of %6, %7, %8)")
+                              .arg(name).arg(width).arg(moments.sum0).arg(moments.sum1).arg(moments.sum2)
+                              .arg(reference.sum0).arg(reference.sum1).arg(reference.sum2);
+            }
+        }
+
+        mLines << QString("%1: rowMoments %2 on %3 rows").arg(name).arg(mismatches ? "FAILED" : "identical").arg(rows);
+        mMismatches += mismatches;
+    }
+
+    return mMismatches == 0;
+}
+
+QString KernelCheck::report() const {
+    QStringList lines;
+    lines << QString("CPU level: %1 (dispatching %2)").arg(CpuDispatch::levelName(CpuDispatch::supportedLevel()))
+             .arg(CpuDispatch::levelName(CpuDispatch::level()));
+    lines << mLines;
+    return lines.join("\n");
+}
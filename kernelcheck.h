@@ -0,0 +1,42 @@
+/*
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef KERNELCHECK_H
+#define KERNELCHECK_H
+
+#include <QString>
+#include <QStringList>
+
+#include "cpudispatch.h"
+
+// Runs every kernel variant the CPU supports against the scalar reference on generated rows
+// (random, saturated, empty, every width up to a few vectors plus the tails) and expects bit-identical results
+class KernelCheck {
+    public:
+        KernelCheck();
+
+    public:
+        bool run(int rows);
+        QString report() const;
+
+    private:
+        QStringList mLines;
+        int mMismatches;
+};
+
+#endif // KERNELCHECK_H
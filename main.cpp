@@ -17,16 +17,210 @@
 */
 
 #include <QtGui/QApplication>
+#include <QStringList>
+#include <QTextStream>
+#include <QThread>
+#include <QFileInfo>
+#include <QSettings>
 
 #include "camerawindow.h"
+#include "processingpool.h"
+#include "allocstats.h"
+#include "alloccheck.h"
+#include "cpudispatch.h"
+#include "kernelcheck.h"
+#include "frameexport.h"
+#include "videoanalysis.h"
+#include "replaybench.h"
+#include "sleeper.h"
+#include "camshiftcheck.h"
 #include "version.h"
 
+// Allocation check of the frame loop: OpenCV --alloc-check [--frames=N] [--warmup=N] [--budget=N] [--yuyv]
+// Exits with 1 if the allocations per frame after the warm-up are over the budget (without budget it only reports)
+static int allocCheck(const QStringList &arguments) {
+    int frames = 300, warmup = 60;
+    double budget = -1;
+
+    foreach(QString argument, arguments) {
+        if(argument.startsWith("--frames=")) frames = argument.mid(9).toInt();
+        if(argument.startsWith("--warmup=")) warmup = argument.mid(9).toInt();
+        if(argument.startsWith("--budget=")) budget = argument.mid(9).toDouble();
+    }
+
+    AllocCheck check;
+    bool passed = check.run(frames, warmup, budget, arguments.contains("--yuyv"));
+    ProcessingPool::release();
+
+    QTextStream out(stdout);
+    out << check.report() << "\n" << (passed ? "PASSED" : "FAILED: over the allocation budget") << "\n";
+    return passed ? 0 : 1;
+}
+
+// Checks the kernel variants against the scalar ones: OpenCV --kernel-check [--rows=N]
+static int kernelCheck(const QStringList &arguments) {
+    int rows = 10000;
+    foreach(QString argument, arguments)
+        if(argument.startsWith("--rows=")) rows = argument.mid(7).toInt();
+
+    KernelCheck check;
+    bool passed = check.run(rows);
+
+    QTextStream out(stdout);
+    out << check.report() << "\n" << (passed ? "PASSED" : "FAILED: the variants differ from the scalar kernels") << "\n";
+    return passed ? 0 : 1;
+}
+
+// Checks the fused and lookup CamShift modes against the reference one on the synthetic source:
+// OpenCV --camshift-check [--frames=N] [--center=px] [--size=fraction] [--angle=degrees]
+static int camshiftCheck(const QStringList &arguments) {
+    int frames = 300;
+    double center = 3, size = 0.1, angle = 5;
+
+    foreach(QString argument, arguments) {
+        if(argument.startsWith("--frames=")) frames = argument.mid(9).toInt();
+        if(argument.startsWith("--center=")) center = argument.mid(9).toDouble();
+        if(argument.startsWith("--size=")) size = argument.mid(7).toDouble();
+        if(argument.startsWith("--angle=")) angle = argument.mid(8).toDouble();
+    }
+
+    CamShiftCheck check;
+    bool passed = check.run(frames, center, size, angle);
+
+    QTextStream out(stdout);
+    out << check.report() << "\n" << (passed ? "PASSED" : "FAILED: the modes differ from the reference") << "\n";
+    return passed ? 0 : 1;
+}
+
+// Test client of the shared memory export: OpenCV --read-export=<camera> [--frames=N]
+// Prints the results of each frame and the mean brightness of its middle row, read in place
+static int readExport(const QStringList &arguments) {
+    int camera = 0, frames = 100;
+
+    foreach(QString argument, arguments) {
+        if(argument.startsWith("--read-export=")) camera = argument.mid(14).toInt();
+        if(argument.startsWith("--frames=")) frames = argument.mid(9).toInt();
+    }
+
+    QTextStream out(stdout);
+    FrameExportReader reader;
+    if(!reader.attach(camera)) {
+        out << "Can't attach to " << FrameExport::key(camera) << "\n";
+        return 1;
+    }
+
+    const ExportHeader *header = reader.header();
+    out << "Reading " << FrameExport::key(camera) << QString(" (%1x%2)").arg(header->width).arg(header->height) << "\n";
+
+    ExportView view;
+    int last = -1, idle = 0;
+    while(frames > 0 && idle < 5000) {
+        if(!reader.acquire(&view, last)) {
+            Sleeper::msleep(1);
+            idle++;
+            continue;
+        }
+
+        const uchar *row = view.pixels + (header->height / 2) * view.stride;
+        int sum = 0;
+        for(quint32 x = 0; x < header->width * 3; x++) sum += row[x];
+
+        // The pixels are only trusted if the writer didn't reuse the slot meanwhile
+        QString brightness = reader.isValid(view) ? QString::number(sum / (header->width * 3.0), 'f', 1) : "overwritten";
+        out << QString("frame %1 at %2 ms: %3 faces, %4, brightness %5").arg(view.sequence).arg(view.timestamp, 0, 'f', 1)
+               .arg(view.faces.size()).arg(view.hasTrack ? "tracking" : "not tracking").arg(brightness) << "\n";
+
+        last = view.sequence;
+        frames--;
+        idle = 0;
+    }
+
+    return 0;
+}
+
+// Offline analysis of a recording: OpenCV --analyze=<video> [--threads=N] [--keyframes=N] [--overlap=N]
+// [--cascade=<file>] [--output=<file>]. The results go to a track log, <video>.analysis.trk by default
+static int analyze(const QStringList &arguments) {
+    QString videoFile, output;
+    int threads = QThread::idealThreadCount(), keyframes = 12, overlap = 24;
+
+    QSettings settings("Kronen Software", "Qt + OpenCV");
+    QString cascadeFile = settings.value("CascadeFile").toString();
+    if(!QFileInfo(cascadeFile).exists()) cascadeFile = QFileInfo("haarcascades/haarcascade_frontalface_alt2.xml").absoluteFilePath();
+
+    foreach(QString argument, arguments) {
+        if(argument.startsWith("--analyze=")) videoFile = argument.mid(10);
+        if(argument.startsWith("--threads=")) threads = argument.mid(10).toInt();
+        if(argument.startsWith("--keyframes=")) keyframes = argument.mid(12).toInt();
+        if(argument.startsWith("--overlap=")) overlap = argument.mid(10).toInt();
+        if(argument.startsWith("--cascade=")) cascadeFile = argument.mid(10);
+        if(argument.startsWith("--output=")) output = argument.mid(9);
+    }
+    if(output.isEmpty()) {
+        QFileInfo video(videoFile);
+        output = video.path() + "/" + video.completeBaseName() + ".analysis.trk";
+    }
+
+    QTextStream out(stdout);
+    VideoAnalysis analysis(videoFile, cascadeFile);
+    if(!analysis.run(threads, keyframes, overlap) || !analysis.writeLog(output)) {
+        out << analysis.errorString() << "\n";
+        return 1;
+    }
+
+    out << analysis.report() << "\n" << "Written " << output << "\n";
+    return 0;
+}
+
+// Throughput of detection and tracking on a raw frame dump: OpenCV --replay=<file> [--full-speed]
+static int replay(const QStringList &arguments) {
+    QString filename;
+    foreach(QString argument, arguments)
+        if(argument.startsWith("--replay=")) filename = argument.mid(9);
+
+    QTextStream out(stdout);
+    ReplayBench bench;
+    bool replayed = bench.run(filename, arguments.contains("--full-speed"));
+    ProcessingPool::release();
+    if(!replayed) {
+        out << bench.errorString() << "\n";
+        return 1;
+    }
+
+    out << bench.report() << "\n";
+    return 0;
+}
+
 int main(int argc, char *argv[]) {
+    // The counting OpenCV allocator has to be set before anything is allocated (ALLOC_CHECK builds)
+    AllocStats::install();
     QApplication app(argc, argv);
 
+    // The kernels are bound to the CPU before any thread uses them. --cpu=scalar|sse2|avx2 forces a lower level
+    CpuDispatch::install();
+    foreach(QString argument, app.arguments()) {
+        CpuDispatch::Level level;
+        if(argument.startsWith("--cpu=") && !(CpuDispatch::parseLevel(argument.mid(6), &level) && CpuDispatch::setLevel(level)))
+            qWarning("Can't use the %s kernels, using %s", qPrintable(argument.mid(6)),
+                     qPrintable(CpuDispatch::levelName(CpuDispatch::level())));
+    }
+
+    if(app.arguments().contains("--alloc-check")) return allocCheck(app.arguments());
+    if(app.arguments().contains("--kernel-check")) return kernelCheck(app.arguments());
+    if(app.arguments().contains("--camshift-check")) return camshiftCheck(app.arguments());
+    foreach(QString argument, app.arguments()) {
+        if(argument.startsWith("--read-export=")) return readExport(app.arguments());
+        if(argument.startsWith("--analyze=")) return analyze(app.arguments());
+        if(argument.startsWith("--replay=")) return replay(app.arguments());
+    }
+
     CameraWindow *mainWin = new CameraWindow();
     mainWin->setWindowTitle(appName + appVersion);
     mainWin->show();
 
-    return app.exec();
+    int result = app.exec();
+
+    // The camera widgets are gone, stop the shared workers
+    ProcessingPool::release();
+    return result;
 }
@@ -18,105 +18,189 @@
 
 #include "opencvwidget.h"
 
-#include <QDebug>
-#include <QFileInfo>
-
-OpenCVWidget::OpenCVWidget(QWidget *parent) : QWidget(parent) {
-    mDetectingFaces = false;
-    mTrackingFace = false;
+OpenCVWidget::OpenCVWidget(int cameraIndex, QWidget *parent) : QWidget(parent) {
     mFlipV = mFlipH = false;
-    mVideoWriter = 0;
     mFps = 16;
-    mCvRect = cvRect(-1, -1, 0, 0);
-    
-    // Camera Initialization
-    mCamera = cvCaptureFromCAM(CV_CAP_ANY);
+    mIdleFps = 4;
+    mCaptureFps = 0;
+    mLastCapture = 0;
+    mWorkerTime = 0;
+    mShowMetrics = false;
+    mBurstFrames = 0;
+    mSnapshotWriter = 0;
+    mCvImage = 0;
+    mFirstFrame = true;
+
+    // Face Detection, Face Tracking and the recordings (the objects that need the frame size are created when the camera opens)
+    mCameraIndex = cameraIndex;
+    mPipeline = new FramePipeline(mCameraIndex);
+    mPipeline->qos()->setPeriod(1000/mFps);
+    connect(mPipeline, SIGNAL(info(QString)), this, SIGNAL(info(QString)));
+    mThrottle = new IdleThrottle();
+    mThrottle->setPeriods(1000/mFps, 1000/mIdleFps);
+
+    // Camera Initialization. The camera lives on its capture thread, cameraOpened() continues when it's
+    // open and queryFrame() gets each frame it captures
+    mStartTime = FrameQoS::now();
+    mOpening = true;
+    mCapture = new CaptureThread(mCameraIndex);
+    mCapture->setPeriod(1000/mFps);
+    connect(mCapture, SIGNAL(opened(bool)), this, SLOT(cameraOpened(bool)));
+    connect(mCapture, SIGNAL(frameReady()), this, SLOT(queryFrame()));
+    mCapture->start();
+}
+
+void OpenCVWidget::cameraOpened(bool opened) {
+    CvSize size = mCapture->frameSize();
+    mOpening = false;
 
-    if(mCamera) {
-        // Get a query frame to initialize the capture and to get the frame's dimensions
-        IplImage* frame = cvQueryFrame(mCamera);
-        this->setMinimumSize(frame->width, frame->height);
+    if(opened) {
+        this->setMinimumSize(size.width, size.height);
 
         // QImage to draw on paint event
-        mImage = QImage(QSize(frame->width, frame->height), QImage::Format_RGB888);
+        mImage = QImage(QSize(size.width, size.height), QImage::Format_RGB888);
 
         // IplImage * to work with OpenCV functions
-        mCvImage = cvCreateImageHeader(cvSize(frame->width, frame->height), 8, 3);
+        mCvImage = cvCreateImageHeader(size, 8, 3);
 
         // Share the buffer between QImage and IplImage *
         mCvImage->imageData = (char *)mImage.bits();
 
-        // Init Face Detection and Face Tracking
-        mFaceDetect = new FaceDetect();
-        mFaceDetect->setFlags(CV_HAAR_FIND_BIGGEST_OBJECT); // default
-        mCamShift = new CamShift(cvSize(frame->width, frame->height));
-
-        // Try to load a default cascade file
-        QFileInfo cascadeFile("haarcascades/haarcascade_frontalface_alt2.xml");
-        if(cascadeFile.exists()) mFaceDetect->setCascadeFile(cascadeFile.absoluteFilePath());
-
-        // We call queryFrame 'mFps' times per second
-        mTimer = new QTimer(this);
-        connect(mTimer, SIGNAL(timeout()), this, SLOT(queryFrame()));
-        mTimer->start(1000/mFps);
+        mPipeline->setFrameSize(size);
+        mSnapshotWriter = new SnapshotWriter(mImage.size(), mImage.format());
     }
+
+    update();
+    emit cameraReady(opened);
 }
 
 OpenCVWidget::~OpenCVWidget() {
-    if(mFaceDetect) delete mFaceDetect;
-    if(mCamShift) delete mCamShift;
-    cvReleaseCapture(&mCamera);
+    // The pipeline waits for its workers. The capture thread releases the camera and then the frame
+    // buffers, none of them is in use once the pipeline is gone
+    delete mPipeline;
+    delete mCapture;
+
+    if(mThrottle) delete mThrottle;
+    if(mSnapshotWriter) delete mSnapshotWriter;
+    if(mCvImage) cvReleaseImageHeader(&mCvImage);
 }
 
+// False while the camera is being opened
 bool OpenCVWidget::isCaptureActive() const {
-    return bool(mCamera);
+    return mCapture->isOpen();
+}
+
+bool OpenCVWidget::isOpening() const {
+    return mOpening;
+}
+
+int OpenCVWidget::cameraIndex() const {
+    return mCameraIndex;
 }
 
 bool OpenCVWidget::isFaceDetectAvalaible() const {
-    return !mFaceDetect->cascadeFile().isEmpty();
+    return !mPipeline->cascadeFile().isEmpty();
 }
 
+// The latest frame of the capture thread (a pooled buffer, shared without copies by the workers)
 void OpenCVWidget::queryFrame() {
-    IplImage* frame = cvQueryFrame(mCamera);
-    if(!frame) return;
-
-    // We copy the frame to our buffer(fliping it if necessary)
-    if(!(mFlipV ^ (frame->origin == IPL_ORIGIN_TL))) cvFlip(frame, mCvImage, 0);
-        else cvCopy(frame, mCvImage, 0);        
-    if(mFlipH) cvFlip(mCvImage, mCvImage, 1);
-
-    if(mVideoWriter) cvWriteFrame(mVideoWriter, frame);
-
-    if(mDetectingFaces) mListRect = mFaceDetect->detectFaces(mCvImage);
-
-    if(mTrackingFace) {
-        // Check if we have a valid rect. If we have a valid one, we track the face,
-        // if not we get a face rect first
-        if(!(mCvRect.width > 0 && mCvRect.height > 0)) {
-            // Detect the Face
-            QVector<QRect> listRect = mFaceDetect->detectFaces(mCvImage);
-
-            if(!listRect.isEmpty()) {
-                QRect trackRect = listRect.at(0);
-                mCvRect = cvRect(trackRect.x(), trackRect.y(), trackRect.width(), trackRect.height());
-                mCamShift->startTracking(mCvImage, mCvRect);
-            }
-        } else {
-            // Track the Face
-            mCvBox = mCamShift->trackFace(mCvImage);
-            cvEllipseBox(mCvImage, mCvBox, CV_RGB(255,0,0), 3, CV_AA, 0);
+    double start = FrameQoS::now();
+    Frame current = mCapture->takeFrame();
+    if(current.isNull()) return;
+    const FrameInfo &frameInfo = current.info();
+
+    if(mLastCapture > 0) {
+        double rate = 1000 / qMax(1.0, frameInfo.timestamp - mLastCapture);
+        mCaptureFps = mCaptureFps ? 0.9 * mCaptureFps + 0.1 * rate : rate;
+    }
+    mLastCapture = frameInfo.timestamp;
+
+    // The frame is already flipped. Without the color image (a source with luma, when nothing needed it)
+    // the stages that use it skip this frame
+    IplImage *luma = current.luma();
+    IplImage *frame = frameInfo.hasImage ? current.image() : 0;
+
+    // An idle camera doesn't repaint the frames that didn't change
+    bool changed = mThrottle->sceneChanged(luma ? luma : frame);
+    bool visible = isVisible() && !window()->isMinimized();
+    bool display = (visible && (changed || !mThrottle->isIdle())) || mBurstFrames > 0;
+    if(visible && !display) mThrottle->skipRepaint();
+
+    // With the luma of the source, detection doesn't need the color frame. The capture thread only converts
+    // it if the display (a hidden window doesn't), tracking, the skin filter or a recording/export uses it
+    mCapture->setColorNeeded(!luma || display || mPipeline->needsColor());
+    display = display && frame;
+
+    // Detection, tracking, recording and export. The results are the latest ones of the workers
+    FrameResults results;
+    FrameTiming timing = mPipeline->feed(current, &results);
+    FrameQoS *qos = mPipeline->qos();
+
+    // Faces, a scene change or a recording keep the full rate, the first one after idling brings it back for the
+    // next frame
+    bool recording = mPipeline->isRecording() || mCapture->isDumping();
+    if(mThrottle->update(timing.captureTime, changed || results.found || recording)) {
+        double period = mThrottle->period();
+        mCapture->setPeriod(period);
+        qos->setPeriod(period);
+        emit info(mThrottle->isIdle() ? QString("Camera %1 idle, capturing at %2 fps").arg(mCameraIndex).arg(1000 / period, 0, 'f', 1)
+                                      : QString("Camera %1 active").arg(mCameraIndex));
+    }
+
+    // Convert it from BGR to RGB into the display buffer. QImage works with RGB and cvQueryFrame returns a BGR
+    // IplImage. The frame itself can't be modified, the workers could be reading it
+    if(display) {
+        cvCvtColor(current.image(), mCvImage, CV_BGR2RGB);
+
+        // Draw the results only if there is still time for it (red on the RGB buffer)
+        if((results.hasBox || !results.faces.isEmpty()) && qos->runStage(timing, FrameQoS::Overlay)) {
+            if(results.hasBox) cvEllipseBox(mCvImage, results.box, cvScalar(255, 0, 0), 3, CV_AA, 0);
+            mListRect = results.faces;
+            qos->endStage(FrameQoS::Overlay);
         }
+
+        update();
     }
 
-    // Convert it from BGR to RGB. QImage works with RGB and cvQueryFrame returns a BGR IplImage
-    cvCvtColor(mCvImage, mCvImage, CV_BGR2RGB);
-    update();
+    if(mFirstFrame) {
+        double time = FrameQoS::now() - mStartTime;
+        emit info(QString("Camera %1: opened in %2 ms, first frame after %3 ms").arg(mCameraIndex)
+                  .arg(mCapture->openTime(), 0, 'f', 0).arg(time, 0, 'f', 0));
+        mFirstFrame = false;
+    }
+
+    if(mBurstFrames > 0) {
+        mSnapshotWriter->capture(mImage);
+        mBurstFrames--;
+    }
+
+    qos->endFrame(timing);
+    double workerTime = mPipeline->totalProcessTime();
+    mThrottle->addWork(FrameQoS::now() - start + workerTime - mWorkerTime);
+    mWorkerTime = workerTime;
+    if(qos->isEnabled() && qos->frames() % 64 == 0) emit info(qos->report());
+        else if(mThrottle->isEnabled() && timing.sequence % 64 == 63) emit info(QString("Camera %1: %2").arg(mCameraIndex).arg(mThrottle->report()));
+}
+
+// Per stream metrics: capture rate, worker time per frame and frames dropped before a worker took them
+QString OpenCVWidget::metrics() const {
+    QString metrics = QString("cam %1: %2 fps, %3 ms/frame, %4 processed, %5 dropped")
+            .arg(mCameraIndex).arg(mCaptureFps, 0, 'f', 1).arg(mPipeline->processTime(), 0, 'f', 1)
+            .arg(mPipeline->processedFrames()).arg(mPipeline->droppedFrames());
+    if(mThrottle->isEnabled()) metrics += ", " + mThrottle->report();
+    return metrics;
+}
+
+void OpenCVWidget::setShowMetrics(bool show) {
+    mShowMetrics = show;
 }
 
 void OpenCVWidget::paintEvent(QPaintEvent *event) {
     QPainter painter(this);
 
     if(!mImage.isNull()) painter.drawPixmap(0, 0, QPixmap::fromImage(mImage));
+        else painter.drawText(rect(), Qt::AlignCenter, mOpening ? tr("Opening camera %1...").arg(mCameraIndex)
+                                                               : tr("Camera %1 not available").arg(mCameraIndex));
 
     if(!mListRect.empty()) {
         QPen pen(palette().dark().color(), 4, Qt::SolidLine, Qt::FlatCap, Qt::BevelJoin);
@@ -126,52 +210,126 @@ void OpenCVWidget::paintEvent(QPaintEvent *event) {
         // Clean the list when we have painted the rects
         mListRect.clear();
     }
-}
 
-void OpenCVWidget::saveScreenshot() {
-    int i = 0;
-    QString filename = QString("webcamPic%1.jpg").arg(i);
-    while(QFileInfo(filename).exists())
-        filename = QString("webcamPic%1.jpg").arg(i++);
+    if(mShowMetrics && isCaptureActive()) {
+        painter.setPen(Qt::yellow);
+        painter.drawText(6, 16, metrics());
+    }
+}
 
-    if(!mImage.isNull()) mImage.save(filename, "JPG", 80);
+// Save the next 'frames' frames (a burst if more than one). They are encoded by the snapshot writer
+void OpenCVWidget::saveScreenshot(int frames) {
+    mBurstFrames = frames;
 }
 
 void OpenCVWidget::videoWrite() {
-    int i = 1;
-    QString filename = QString("webcamVid%1.avi").arg(i);
-    while(QFileInfo(filename).exists())
-        filename = QString("webcamVid%1.avi").arg(i++);
+    mPipeline->startRecording(SnapshotWriter::nextFileName("NextVideo", "webcamVid%1.avi", 1));
+}
+
+void OpenCVWidget::videoStop() {
+    mPipeline->stopRecording();
+}
 
-    CvSize size = cvGetSize(mCvImage);
+// Dump the captured frames without compression, to replay them later (OpenCV --replay=<file>)
+// They're written by the capture thread, as the camera gives them (before the flips)
+void OpenCVWidget::rawWrite() {
+    if(!isCaptureActive() || mCapture->isDumping()) return;
 
-    // It seems that my camera don't get more than 8 fps at 640x480
-    mVideoWriter = cvCreateVideoWriter(filename.toUtf8(), CV_FOURCC('D','I','V','X'), 8, size);
+    QString filename = SnapshotWriter::nextFileName("NextRaw", "webcamRaw%1.qcvraw", 1);
+    if(mCapture->startDump(filename)) emit info("Writing raw frames to " + filename);
 }
 
-void OpenCVWidget::videoStop() {
-    cvReleaseVideoWriter(&mVideoWriter);
+void OpenCVWidget::rawStop() {
+    mCapture->stopDump();
+}
+
+// Record automatically when faces appear, starting some seconds before them
+void OpenCVWidget::setAutoRecord(bool enabled) {
+    mPipeline->setAutoRecord(enabled);
+}
+
+bool OpenCVWidget::isAutoRecord() const {
+    return mPipeline->isAutoRecord();
+}
+
+void OpenCVWidget::setAutoRecordTimes(double preRoll, double timeout) {
+    mPipeline->setAutoRecordTimes(preRoll, timeout);
 }
 
 void OpenCVWidget::setDetectFaces(bool detect) {
-    mDetectingFaces = detect;
+    mPipeline->setDetectFaces(detect);
+}
+
+void OpenCVWidget::setTrackFace(bool track, FramePipeline::Tracker tracker) {
+    mPipeline->setTrackFace(track, tracker);
 }
 
-void OpenCVWidget::setTrackFace(bool track) {
-    mTrackingFace = track;
-    if(!mTrackingFace) mCvRect = cvRect(-1, -1, 0, 0);
+FramePipeline::Tracker OpenCVWidget::tracker() const {
+    return mPipeline->tracker();
 }
 
 void OpenCVWidget::setFaceDetectFlags(int flags) {
-    mFaceDetect->setFlags(flags);
+    mPipeline->setFaceDetectFlags(flags);
+}
+
+void OpenCVWidget::setSkinFilter(bool enabled) {
+    mPipeline->setSkinFilter(enabled);
+}
+
+bool OpenCVWidget::isSkinFilterEnabled() const {
+    return mPipeline->isSkinFilterEnabled();
 }
 
+void OpenCVWidget::setDetectBudget(double ms) {
+    mPipeline->setDetectBudget(ms);
+}
+
+double OpenCVWidget::detectBudget() const {
+    return mPipeline->detectBudget();
+}
+
+DetectParams OpenCVWidget::detectParams() const {
+    return mPipeline->detectParams();
+}
+
+// Skip the optional work (detection, overlay, recording) of the frames that are already late
+void OpenCVWidget::setQoS(bool enabled) {
+    mPipeline->qos()->setEnabled(enabled);
+}
+
+bool OpenCVWidget::isQoSEnabled() const {
+    return mPipeline->qos()->isEnabled();
+}
+
+// Lower the capture rate while there are no faces and the scene doesn't change
+void OpenCVWidget::setIdleThrottle(bool enabled) {
+    mThrottle->setEnabled(enabled);
+    mCapture->setPeriod(1000/mFps);
+    mPipeline->qos()->setPeriod(1000/mFps);
+}
+
+bool OpenCVWidget::isIdleThrottleEnabled() const {
+    return mThrottle->isEnabled();
+}
+
+// Publish the frames and results on shared memory (FrameExport::key() of the camera index)
+void OpenCVWidget::setExport(bool enabled) {
+    if(!enabled || isCaptureActive()) mPipeline->setExport(enabled);
+}
+
+bool OpenCVWidget::isExportEnabled() const {
+    return mPipeline->isExportEnabled();
+}
+
+// The capture thread flips the frames it copies
 void OpenCVWidget::switchFlipH() {
     mFlipH = !mFlipH;
+    mCapture->setFlip(mFlipH, mFlipV);
 }
 
 void OpenCVWidget::switchFlipV() {
     mFlipV = !mFlipV;
+    mCapture->setFlip(mFlipH, mFlipV);
 }
 
 bool OpenCVWidget::flipH() const {
@@ -183,26 +341,41 @@ bool OpenCVWidget::flipV() const {
 }
 
 void OpenCVWidget::setCascadeFile(QString filename) {
-    mFaceDetect->setCascadeFile(filename);
+    mPipeline->setCascadeFile(filename);
 }
 
 QString OpenCVWidget::cascadeFile() const {
-    if(mFaceDetect) return mFaceDetect->cascadeFile();
-        else return "";
+    return mPipeline->cascadeFile();
 }
 
 void OpenCVWidget::setCamShiftVMin(int vMin) {
-    mCamShift->setVMin(vMin);
+    mPipeline->setCamShiftVMin(vMin);
 }
 
 void OpenCVWidget::setCamShiftSMin(int sMin) {
-    mCamShift->setSMin(sMin);
+    mPipeline->setCamShiftSMin(sMin);
 }
 
 int OpenCVWidget::camshiftVMin() const {
-    return mCamShift->vMin();
+    return mPipeline->camshiftVMin();
 }
 
 int OpenCVWidget::camshiftSMin() const{
-   return mCamShift->sMin();
+   return mPipeline->camshiftSMin();
+}
+
+void OpenCVWidget::setCamShiftMode(CamShift::Mode mode) {
+    mPipeline->setCamShiftMode(mode);
+}
+
+CamShift::Mode OpenCVWidget::camshiftMode() const {
+    return mPipeline->camshiftMode();
+}
+
+void OpenCVWidget::setCamShiftPrediction(bool prediction) {
+    mPipeline->setCamShiftPrediction(prediction);
+}
+
+bool OpenCVWidget::camshiftPrediction() const {
+    return mPipeline->camshiftPrediction();
 }
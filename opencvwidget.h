@@ -23,30 +23,44 @@
 #include <QtGui/QPixmap>
 #include <QtGui/QImage>
 #include <QtGui/QPainter>
-#include <QTimer>
 
 #include "cv.h"
 #include "highgui.h"
 
-#include "facedetect.h"
-#include "camshift.h"
+#include "framepipeline.h"
+#include "idlethrottle.h"
+#include "capturethread.h"
+#include "snapshotwriter.h"
 
+// Shows a camera. The camera is grabbed on its CaptureThread and the frames go through its FramePipeline on
+// the GUI thread, while detection and tracking run on the shared ProcessingPool; their latest results are
+// drawn over the following frames.
 class OpenCVWidget : public QWidget {
     Q_OBJECT
 
 signals:
     void info(const QString &str);
+    void cameraReady(bool opened);
 
 public:
-    OpenCVWidget(QWidget *parent = 0);
+    OpenCVWidget(int cameraIndex = CV_CAP_ANY, QWidget *parent = 0);
     ~OpenCVWidget();
 
     bool isCaptureActive() const;
+    bool isOpening() const;
+    int cameraIndex() const;
+    QString metrics() const;
+    void setShowMetrics(bool show);
     bool isFaceDetectAvalaible() const;
 
-    void saveScreenshot();
+    void saveScreenshot(int frames = 1);
     void videoWrite();
     void videoStop();
+    void rawWrite();
+    void rawStop();
+    void setAutoRecord(bool enabled);
+    bool isAutoRecord() const;
+    void setAutoRecordTimes(double preRoll, double timeout);
 
     void switchFlipH();
     void switchFlipV();
@@ -54,46 +68,63 @@ public:
     bool flipV() const;
 
     void setDetectFaces(bool);
-    void setTrackFace(bool);
+    void setTrackFace(bool track, FramePipeline::Tracker tracker = FramePipeline::CamShiftTracker);
+    FramePipeline::Tracker tracker() const;
     void setFaceDetectFlags(int flags);
+    void setSkinFilter(bool enabled);
+    bool isSkinFilterEnabled() const;
+    void setDetectBudget(double ms);
+    double detectBudget() const;
+    DetectParams detectParams() const;
+    void setQoS(bool enabled);
+    bool isQoSEnabled() const;
+    void setIdleThrottle(bool enabled);
+    bool isIdleThrottleEnabled() const;
+    void setExport(bool enabled);
+    bool isExportEnabled() const;
 
     void setCascadeFile(QString filename);
     QString cascadeFile() const;
 
     int camshiftSMin() const;
     int camshiftVMin() const;    
+    void setCamShiftMode(CamShift::Mode mode);
+    CamShift::Mode camshiftMode() const;
+    void setCamShiftPrediction(bool prediction);
+    bool camshiftPrediction() const;
 
 protected:
     void paintEvent(QPaintEvent *event);
 
-private:
-    QVector<QRect> detectFaces(IplImage *cvImage);
-    void trackFace(CvRect cvRect);
-
 private slots:
+    void cameraOpened(bool opened);
     void queryFrame();
     void setCamShiftVMin(int vMin);
     void setCamShiftSMin(int sMin);    
 
 private:
-    CvCapture *mCamera;
+    int mCameraIndex;
+    CaptureThread *mCapture;
+    bool mOpening;              // Until the capture thread opens the camera
+    FramePipeline *mPipeline;
+    double mStartTime;
+    bool mFirstFrame;           // Time to first frame not logged yet
     IplImage *mCvImage;
     QImage mImage;
 
-    CvVideoWriter *mVideoWriter;
-    FaceDetect *mFaceDetect;
-    CamShift *mCamShift;
+    IdleThrottle *mThrottle;    // Lower rate when nothing happens
+    SnapshotWriter *mSnapshotWriter;
+    int mBurstFrames;           // Frames left to save
 
     QVector<QRect> mListRect;
-    CvBox2D mCvBox;
-    CvRect mCvRect;
 
-    bool mDetectingFaces;
-    bool mTrackingFace;
     bool mFlipV, mFlipH;
     double mFps;
-
-    QTimer *mTimer;
+    double mIdleFps;            // Capture rate of an idle camera
+    double mCaptureFps;         // Measured capture rate
+    double mLastCapture;
+    double mWorkerTime;             // Worker time of the pipeline already counted by the throttle
+    bool mShowMetrics;
 };
 
 #endif
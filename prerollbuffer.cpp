@@ -0,0 +1,102 @@
+/*
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include "prerollbuffer.h"
+
+PreRollBuffer::PreRollBuffer(double seconds, int maxBytes) {
+    mSeconds = seconds;
+    mMaxBytes = maxBytes;
+    mBytes = 0;
+    mQuality = 75;
+}
+
+PreRollBuffer::~PreRollBuffer() {
+    clear();
+}
+
+void PreRollBuffer::addFrame(const IplImage *frame, double time) {
+    int params[] = { CV_IMWRITE_JPEG_QUALITY, mQuality, 0 };
+
+    Frame compressed;
+    compressed.jpeg = cvEncodeImage(".jpg", frame, params);
+    compressed.time = time;
+    compressed.origin = frame->origin;
+    if(!compressed.jpeg) return;
+
+    mFrames.enqueue(compressed);
+    mBytes += compressed.jpeg->cols * compressed.jpeg->rows;
+
+    dropOldFrames(time);
+}
+
+// Keep the frames of the last mSeconds seconds that fit in mMaxBytes
+void PreRollBuffer::dropOldFrames(double now) {
+    while(!mFrames.isEmpty() && (now - mFrames.head().time > mSeconds * 1000 || mBytes > mMaxBytes)) {
+        Frame frame = mFrames.dequeue();
+        mBytes -= frame.jpeg->cols * frame.jpeg->rows;
+        cvReleaseMat(&frame.jpeg);
+    }
+}
+
+void PreRollBuffer::clear() {
+    while(!mFrames.isEmpty()) {
+        Frame frame = mFrames.dequeue();
+        cvReleaseMat(&frame.jpeg);
+    }
+    mBytes = 0;
+}
+
+// Only one decoded frame is alive at a time, however long the pre-roll is
+int PreRollBuffer::writeTo(CvVideoWriter *writer) {
+    int written = 0;
+
+    while(!mFrames.isEmpty()) {
+        Frame frame = mFrames.dequeue();
+        mBytes -= frame.jpeg->cols * frame.jpeg->rows;
+        IplImage *image = cvDecodeImage(frame.jpeg, CV_LOAD_IMAGE_COLOR);
+        cvReleaseMat(&frame.jpeg);
+        if(!image) continue;
+
+        // The encoder stores the image top-left, give it back as the camera delivered it
+        if(frame.origin == IPL_ORIGIN_BL) {
+            cvFlip(image, image, 0);
+            image->origin = IPL_ORIGIN_BL;
+        }
+        cvWriteFrame(writer, image);
+        cvReleaseImage(&image);
+        written++;
+    }
+
+    return written;
+}
+
+void PreRollBuffer::setDuration(double seconds) {
+    mSeconds = seconds;
+}
+
+double PreRollBuffer::duration() const {
+    return mSeconds;
+}
+
+int PreRollBuffer::frames() const {
+    return mFrames.size();
+}
+
+int PreRollBuffer::bytes() const {
+    return mBytes;
+}
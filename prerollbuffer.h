@@ -0,0 +1,64 @@
+/*
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef PREROLLBUFFER_H
+#define PREROLLBUFFER_H
+
+#include <QQueue>
+
+#include "cv.h"
+#include "highgui.h"
+
+// Ring of the most recent frames, JPEG compressed in memory.
+// It's bounded both in duration and in bytes, the oldest frames are dropped first.
+class PreRollBuffer {
+    public:
+        PreRollBuffer(double seconds = 3, int maxBytes = 16 * 1024 * 1024);
+        ~PreRollBuffer();
+
+    public:
+        void addFrame(const IplImage *frame, double time);
+        void clear();
+
+        // Decode and write the frames from the oldest one, one at a time, and empty the buffer.
+        // Returns the frames written
+        int writeTo(CvVideoWriter *writer);
+
+        void setDuration(double seconds);
+        double duration() const;
+        int frames() const;
+        int bytes() const;
+
+    private:
+        void dropOldFrames(double now);
+
+    private:
+        struct Frame {
+            CvMat *jpeg;
+            double time;
+            int origin;
+        };
+
+        QQueue<Frame> mFrames;
+        double mSeconds;
+        int mMaxBytes;
+        int mBytes;
+        int mQuality;
+};
+
+#endif // PREROLLBUFFER_H
@@ -0,0 +1,214 @@
+/*
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include "processingpool.h"
+
+#include <QMutexLocker>
+
+ProcessingStream::ProcessingStream() {
+    mStopped = false;
+    mBusy = false;
+    mProcessed = mDropped = 0;
+    mProcessTime = mProcessTotal = 0;
+
+    ProcessingPool::instance()->addStream(this);
+}
+
+ProcessingStream::~ProcessingStream() {
+    stopProcessing();
+}
+
+void ProcessingStream::stopProcessing() {
+    if(mStopped) return;
+    ProcessingPool::instance()->removeStream(this);
+    mStopped = true;
+
+    // The frame buffers belong to the derived class
+    QMutexLocker locker(&mFrameLock);
+    mPending.release();
+}
+
+bool ProcessingStream::submitFrame(const Frame &frame) {
+    bool replaced;
+    {
+        QMutexLocker locker(&mFrameLock);
+        replaced = !mPending.isNull();
+        if(replaced) mDropped++;
+        mPending = frame;
+    }
+
+    ProcessingPool::instance()->submit(this);
+    return !replaced;
+}
+
+// Called by a worker: take the pending frame and process it
+void ProcessingStream::run() {
+    Frame work;
+    {
+        QMutexLocker locker(&mFrameLock);
+        if(mPending.isNull()) return;
+        work = mPending;
+        mPending.release();
+        mBusy = true;
+    }
+
+    double timeElapsed = (double)cvGetTickCount();
+    processFrame(work);
+    timeElapsed = ((double)cvGetTickCount() - timeElapsed)/((double)cvGetTickFrequency()*1000);
+
+    // The frame goes back to its pool before the waiting thread wakes up
+    work.release();
+
+    QMutexLocker locker(&mFrameLock);
+    mProcessTime = mProcessed ? 0.9 * mProcessTime + 0.1 * timeElapsed : timeElapsed;
+    mProcessTotal += timeElapsed;
+    mProcessed++;
+    mBusy = false;
+    mIdle.wakeAll();
+}
+
+void ProcessingStream::waitForIdle() {
+    QMutexLocker locker(&mFrameLock);
+    while((!mPending.isNull() || mBusy) && !mStopped) mIdle.wait(&mFrameLock);
+}
+
+int ProcessingStream::processedFrames() const {
+    QMutexLocker locker(&mFrameLock);
+    return mProcessed;
+}
+
+int ProcessingStream::droppedFrames() const {
+    QMutexLocker locker(&mFrameLock);
+    return mDropped;
+}
+
+double ProcessingStream::processTime() const {
+    QMutexLocker locker(&mFrameLock);
+    return mProcessTime;
+}
+
+double ProcessingStream::totalProcessTime() const {
+    QMutexLocker locker(&mFrameLock);
+    return mProcessTotal;
+}
+
+
+ProcessingPool *ProcessingPool::mInstance = 0;
+
+// One worker per core
+ProcessingPool *ProcessingPool::instance() {
+    if(!mInstance) mInstance = new ProcessingPool(qMax(1, QThread::idealThreadCount()));
+    return mInstance;
+}
+
+// Stop the workers, all the streams must be destroyed before
+void ProcessingPool::release() {
+    delete mInstance;
+    mInstance = 0;
+}
+
+ProcessingPool::ProcessingPool(int workers) {
+    mNext = 0;
+    mQuit = false;
+
+    for(int i = 0; i < workers; i++) {
+        QThread *worker = new ProcessingWorker(this);
+        worker->start();
+        mWorkers.append(worker);
+    }
+}
+
+ProcessingPool::~ProcessingPool() {
+    {
+        QMutexLocker locker(&mMutex);
+        mQuit = true;
+        mWorkAvailable.wakeAll();
+    }
+
+    foreach(QThread *worker, mWorkers) {
+        worker->wait();
+        delete worker;
+    }
+}
+
+int ProcessingPool::workerCount() const {
+    return mWorkers.size();
+}
+
+void ProcessingPool::addStream(ProcessingStream *stream) {
+    QMutexLocker locker(&mMutex);
+    mStreams.append(stream);
+}
+
+void ProcessingPool::removeStream(ProcessingStream *stream) {
+    QMutexLocker locker(&mMutex);
+    mStreams.removeAll(stream);
+    mPending.remove(stream);
+    while(mRunning.contains(stream)) mJobFinished.wait(&mMutex);
+}
+
+void ProcessingPool::submit(ProcessingStream *stream) {
+    QMutexLocker locker(&mMutex);
+    if(!mStreams.contains(stream)) return;
+    mPending.insert(stream);
+    mWorkAvailable.wakeOne();
+}
+
+// Blocks until a stream has work. The search starts after the last served stream (fair scheduling)
+ProcessingStream *ProcessingPool::nextJob() {
+    QMutexLocker locker(&mMutex);
+
+    while(!mQuit) {
+        for(int i = 0; i < mStreams.size(); i++) {
+            int index = (mNext + i) % mStreams.size();
+            ProcessingStream *stream = mStreams.at(index);
+
+            if(mPending.contains(stream) && !mRunning.contains(stream)) {
+                mPending.remove(stream);
+                mRunning.insert(stream);
+                mNext = index + 1;
+                return stream;
+            }
+        }
+        mWorkAvailable.wait(&mMutex);
+    }
+
+    return 0;
+}
+
+void ProcessingPool::jobDone(ProcessingStream *stream) {
+    QMutexLocker locker(&mMutex);
+    mRunning.remove(stream);
+    mJobFinished.wakeAll();
+
+    // The stream could have received a frame while it was running
+    if(mPending.contains(stream)) mWorkAvailable.wakeOne();
+}
+
+
+ProcessingWorker::ProcessingWorker(ProcessingPool *pool) : QThread() {
+    mPool = pool;
+}
+
+void ProcessingWorker::run() {
+    ProcessingStream *stream;
+    while((stream = mPool->nextJob())) {
+        stream->run();
+        mPool->jobDone(stream);
+    }
+}
@@ -0,0 +1,126 @@
+/*
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef PROCESSINGPOOL_H
+#define PROCESSINGPOOL_H
+
+#include <QList>
+#include <QSet>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QThread>
+
+#include "cv.h"
+
+#include "frame.h"
+
+class ProcessingPool;
+
+// A source of frames (a camera) whose detection/tracking work runs on the shared ProcessingPool.
+// The stream keeps one pending frame (shared, not copied): submitting a new one before a worker takes it replaces it,
+// so a slow stream drops its own frames instead of queuing latency or starving the others.
+class ProcessingStream {
+    public:
+        ProcessingStream();
+        virtual ~ProcessingStream();
+
+    public:
+        // Statistics (thread-safe)
+        int processedFrames() const;
+        int droppedFrames() const;
+        double processTime() const;
+        double totalProcessTime() const;    // Milliseconds of all the jobs
+
+    protected:
+        // Hand the frame to the workers. Returns false if a pending frame was replaced
+        bool submitFrame(const Frame &frame);
+
+        // Blocks until the submitted frame has been processed (benchmarks that need the results of each frame)
+        void waitForIdle();
+
+        // Runs on a worker thread, never concurrently for the same stream
+        virtual void processFrame(const Frame &frame) = 0;
+
+        // Must be called on the derived destructor, it waits for the running job to finish
+        void stopProcessing();
+
+    private:
+        friend class ProcessingWorker;
+        void run();
+
+    private:
+        mutable QMutex mFrameLock;
+        QWaitCondition mIdle;
+        Frame mPending;             // Last submitted frame
+        bool mBusy;                 // A worker is processing a frame
+        bool mStopped;
+
+        int mProcessed;
+        int mDropped;
+        double mProcessTime;        // Smoothed milliseconds per job
+        double mProcessTotal;
+};
+
+// Worker threads shared by all the streams of the process.
+// Streams are served round-robin, a stream is never processed by two workers at once.
+class ProcessingPool {
+    public:
+        static ProcessingPool *instance();
+        static void release();
+
+    public:
+        void addStream(ProcessingStream *stream);
+        void removeStream(ProcessingStream *stream);
+        void submit(ProcessingStream *stream);
+        int workerCount() const;
+
+    private:
+        ProcessingPool(int workers);
+        ~ProcessingPool();
+
+        friend class ProcessingWorker;
+        ProcessingStream *nextJob();
+        void jobDone(ProcessingStream *stream);
+
+    private:
+        static ProcessingPool *mInstance;
+
+        QMutex mMutex;
+        QWaitCondition mWorkAvailable;
+        QWaitCondition mJobFinished;
+
+        QList<ProcessingStream *> mStreams;
+        QSet<ProcessingStream *> mPending;
+        QSet<ProcessingStream *> mRunning;
+        QList<QThread *> mWorkers;
+        int mNext;                  // Round-robin position
+        bool mQuit;
+};
+
+class ProcessingWorker : public QThread {
+    public:
+        ProcessingWorker(ProcessingPool *pool);
+
+    protected:
+        void run();
+
+    private:
+        ProcessingPool *mPool;
+};
+
+#endif // PROCESSINGPOOL_H
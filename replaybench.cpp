@@ -0,0 +1,154 @@
+/*
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include "replaybench.h"
+
+#include <QFileInfo>
+#include <QStringList>
+
+#include "framedump.h"
+#include "frame.h"
+#include "frameqos.h"
+#include "sleeper.h"
+
+static const char *stageNames[ReplayBench::StageCount] = { "copy", "detection", "tracking", "recording" };
+
+ReplayBench::ReplayBench() {
+    mFullSpeed = false;
+    mDetection = false;
+    mFrames = mLateFrames = mFaceFrames = 0;
+    mProcessed = mDropped = 0;
+    mWorkTime = 0;
+    mTime = mMediaTime = 0;
+    for(int i = 0; i < StageCount; i++) mStageTime[i] = 0;
+}
+
+// Called by the pipeline at full speed, from the worker for detection and tracking (it's waited for)
+void ReplayBench::stageStarted(int stage) {
+    Stage mapped = stage == FramePipeline::Detection ? Detection : stage == FramePipeline::Tracking ? Tracking : Recording;
+    mMarks[mapped] = FrameQoS::now();
+    mMarked[mapped] = true;
+}
+
+bool ReplayBench::run(const QString &filename, bool fullSpeed) {
+    mFileName = filename;
+    mFullSpeed = fullSpeed;
+
+    FrameDumpSource source(filename);
+    if(!source.isOpen()) {
+        mError = "Can't read the frame dump " + filename;
+        return false;
+    }
+    const FrameDumpHeader *header = source.header();
+    CvSize size = cvSize(header->width, header->height);
+
+    // The pipeline of a camera, tracking from the first face found
+    FramePool pool(size, 8, 3, 6, header->format == FrameDumpHeader::Gray8);
+    FramePipeline pipeline;
+    pipeline.setFrameSize(size);
+    pipeline.setFaceDetectFlags(CV_HAAR_FIND_BIGGEST_OBJECT);
+    QFileInfo cascadeFile("haarcascades/haarcascade_frontalface_alt2.xml");
+    if(cascadeFile.exists()) pipeline.setCascadeFile(cascadeFile.absoluteFilePath());
+    mDetection = !pipeline.cascadeFile().isEmpty();
+    pipeline.setTrackFace(mDetection);
+    if(mFullSpeed) {
+        pipeline.setSynchronous(true);
+        pipeline.setProbe(this);
+    }
+
+    double start = FrameQoS::now();
+    qint64 first = 0, previous = 0;
+
+    while(source.grabFrame()) {
+        qint64 timestamp = source.timestamp();
+        if(mFrames == 0) first = previous = timestamp;
+
+        // At the original rate each frame waits for its time since the first one, like a capture tick
+        double due = start + (timestamp - first) / 1000.0;
+        if(!mFullSpeed && FrameQoS::now() < due) Sleeper::msleep((unsigned long)(due - FrameQoS::now()));
+        for(int stage = 0; stage < StageCount; stage++) mMarked[stage] = false;
+        double frameStart = mMarks[Copy] = FrameQoS::now();
+
+        // Copied to a pooled frame (top-left) like the capture thread does, the color only if it's needed
+        Frame frame = pool.acquire();
+        if(frame.isNull()) continue;
+        FrameInfo info;
+        info.sequence = mFrames;
+        info.timestamp = mFullSpeed ? frameStart : due;
+        IplImage *luma = source.retrieveLuma();
+        frame.fill(!luma || pipeline.needsColor() ? source.retrieveFrame() : 0, luma, info);
+
+        FrameResults results;
+        FrameTiming timing = pipeline.feed(frame, &results);
+        pipeline.qos()->endFrame(timing);
+        frame.release();
+        double end = mMarks[StageCount] = FrameQoS::now();
+        if(results.found) mFaceFrames++;
+
+        if(mFullSpeed) {
+            // A stage the pipeline skipped took nothing
+            for(int stage = StageCount - 1; stage > Copy; stage--)
+                if(!mMarked[stage]) mMarks[stage] = mMarks[stage + 1];
+            for(int stage = 0; stage < StageCount; stage++) mStageTime[stage] += mMarks[stage + 1] - mMarks[stage];
+
+            // Late: the work took longer than the time to the next frame of the recording
+            if(mFrames > 0 && end - frameStart > (timestamp - previous) / 1000.0) mLateFrames++;
+        }
+        previous = timestamp;
+        mFrames++;
+    }
+
+    mTime = FrameQoS::now() - start;
+    mMediaTime = (previous - first) / 1000.0;
+    mProcessed = pipeline.processedFrames();
+    mDropped = pipeline.droppedFrames();
+    mWorkTime = pipeline.processTime();
+    mQoSReport = pipeline.qos()->report();
+    return true;
+}
+
+QString ReplayBench::report() const {
+    QStringList lines;
+    int frames = qMax(1, mFrames);
+
+    if(!mDetection) lines << "No cascade file found, detection and tracking skipped";
+    lines << QString("%1: %2 frames, %3 s recorded, replayed %4").arg(mFileName).arg(mFrames)
+             .arg(mMediaTime / 1000, 0, 'f', 1).arg(mFullSpeed ? "at full speed" : "at the original rate");
+
+    if(mFullSpeed) {
+        double work = 0;
+        for(int stage = 0; stage < StageCount; stage++) {
+            work += mStageTime[stage];
+            lines << QString("%1: %2 ms per frame").arg(stageNames[stage], -10).arg(mStageTime[stage] / frames, 0, 'f', 2);
+        }
+
+        lines << QString("total: %1 ms per frame, %2 fps of work, %3 fps replayed").arg(work / frames, 0, 'f', 2)
+                 .arg(work > 0 ? mFrames * 1000 / work : 0, 0, 'f', 1).arg(mTime > 0 ? mFrames * 1000 / mTime : 0, 0, 'f', 1);
+        lines << QString("%1 frames with faces, %2 frames late for the recorded rate").arg(mFaceFrames).arg(mLateFrames);
+    } else {
+        lines << QString("workers: %1 frames processed, %2 dropped, %3 ms per frame").arg(mProcessed).arg(mDropped)
+                 .arg(mWorkTime, 0, 'f', 2);
+        lines << QString("%1 frames with faces").arg(mFaceFrames);
+        lines << mQoSReport;
+    }
+    return lines.join("\n");
+}
+
+QString ReplayBench::errorString() const {
+    return mError;
+}
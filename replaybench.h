@@ -0,0 +1,63 @@
+/*
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef REPLAYBENCH_H
+#define REPLAYBENCH_H
+
+#include <QString>
+
+#include "framepipeline.h"
+
+// Replays a raw frame dump (framedump.h) through a FramePipeline and measures it without camera or codec
+// noise. At the original rate the frames are fed at their recorded times and the workers run like in the
+// application (frames they can't keep up with are dropped); at full speed the pipeline waits for the
+// workers on each frame and the time of each stage is measured.
+class ReplayBench : public PipelineProbe {
+    public:
+        enum Stage { Copy, Detection, Tracking, Recording, StageCount };
+
+        ReplayBench();
+
+    public:
+        bool run(const QString &filename, bool fullSpeed);
+        QString report() const;
+        QString errorString() const;
+
+        void stageStarted(int stage);
+
+    private:
+        QString mFileName;
+        QString mError;
+        bool mFullSpeed;
+        bool mDetection;            // A cascade was found
+
+        int mFrames;
+        int mLateFrames;
+        int mFaceFrames;            // Frames with faces or a track
+        int mProcessed;             // Frames the workers got
+        int mDropped;               // Frames replaced before a worker took them
+        double mWorkTime;           // Smoothed time of the workers per frame (ms)
+        QString mQoSReport;
+        double mTime;               // Wall time of the replay (ms)
+        double mMediaTime;          // Duration of the recording (ms)
+        double mMarks[StageCount + 1];
+        bool mMarked[StageCount];
+        double mStageTime[StageCount];
+};
+
+#endif // REPLAYBENCH_H
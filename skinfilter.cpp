@@ -0,0 +1,158 @@
+/*
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include "skinfilter.h"
+
+#include <math.h>
+
+SkinFilter::SkinFilter() {
+    mHistBins[0] = 30;
+    mHistBins[1] = 32;
+    mHueRanges[0] = 0;
+    mHueRanges[1] = 180;
+    mSatRanges[0] = 0;
+    mSatRanges[1] = 256;
+    mVMin = 50;
+    mVMax = 256;
+    mSMin = 50;
+    mReduction = 4;
+    mMinArea = 48;
+
+    mHueImg = mSatImg = mMask = mProbImg = 0;
+    mStorage = cvCreateMemStorage(0);
+
+    createModel();
+}
+
+SkinFilter::~SkinFilter() {
+    updateImages(cvSize(0, 0));
+    cvReleaseHist(&mHist);
+    cvReleaseMemStorage(&mStorage);
+}
+
+// The skin model is a hue/saturation histogram like the one CamShift calculates on startTracking(),
+// but built from a fixed skin tone: hue close to red-orange (with wrap around 180) and medium saturation
+void SkinFilter::createModel() {
+    float *ranges[] = { mHueRanges, mSatRanges };
+    mHist = cvCreateHist(2, mHistBins, CV_HIST_ARRAY, ranges, 1);
+
+    double hueStep = (mHueRanges[1] - mHueRanges[0]) / mHistBins[0];
+    double satStep = (mSatRanges[1] - mSatRanges[0]) / mHistBins[1];
+
+    for(int h = 0; h < mHistBins[0]; h++) {
+        double hue = (h + 0.5) * hueStep;
+        double dHue = MIN(fabs(hue - 10.0), 180.0 - fabs(hue - 10.0));
+        double hueWeight = exp(-(dHue * dHue) / (2.0 * 12.0 * 12.0));
+
+        for(int s = 0; s < mHistBins[1]; s++) {
+            double sat = (s + 0.5) * satStep;
+            double satWeight = 1.0;
+            if(sat < 40) satWeight = sat / 40.0;
+                else if(sat > 180) satWeight = MAX(0.0, (256.0 - sat) / 76.0);
+
+            *cvGetHistValue_2D(mHist, h, s) = (float)(255.0 * hueWeight * satWeight);
+        }
+    }
+}
+
+// (Re)allocate the working images when the reduced frame size changes. A 0x0 size only releases them
+void SkinFilter::updateImages(CvSize size) {
+    if(mHueImg && mHueImg->width == size.width && mHueImg->height == size.height) return;
+
+    if(mHueImg) {
+        cvReleaseImage(&mHueImg);
+        cvReleaseImage(&mSatImg);
+        cvReleaseImage(&mMask);
+        cvReleaseImage(&mProbImg);
+    }
+
+    if(size.width > 0 && size.height > 0) {
+        mHueImg   = cvCreateImage(size, 8, 1);
+        mSatImg   = cvCreateImage(size, 8, 1);
+        mMask     = cvCreateImage(size, 8, 1);
+        mProbImg  = cvCreateImage(size, 8, 1);
+    }
+}
+
+QVector<CvRect> SkinFilter::candidateRegions(FrameImages *images) {
+    QVector<CvRect> regions;
+    CvSeq *contours = 0;
+    const IplImage *cvImage = images->frame();
+    IplImage *hsv = images->smallHSV(mReduction);
+
+    updateImages(cvGetSize(hsv));
+
+    // Skin probability map of the reduced frame, masking the pixels too close to neutral
+    cvInRangeS(hsv, cvScalar(0, mSMin, MIN(mVMin, mVMax), 0), cvScalar(180, 256, MAX(mVMin, mVMax), 0), mMask);
+    cvSplit(hsv, mHueImg, mSatImg, 0, 0);
+
+    IplImage *planes[] = { mHueImg, mSatImg };
+    cvCalcBackProject(planes, mProbImg, mHist);
+    cvAnd(mProbImg, mMask, mProbImg, 0);
+
+    // Binarize and join the blobs split by eyes, eyebrows or mouth
+    cvThreshold(mProbImg, mProbImg, 64, 255, CV_THRESH_BINARY);
+    cvDilate(mProbImg, mProbImg, 0, 2);
+
+    cvClearMemStorage(mStorage);
+    cvFindContours(mProbImg, mStorage, &contours, sizeof(CvContour), CV_RETR_EXTERNAL, CV_CHAIN_APPROX_SIMPLE);
+
+    for(; contours; contours = contours->h_next) {
+        CvRect rect = cvBoundingRect(contours, 0);
+        if(rect.width * rect.height < mMinArea) continue;
+
+        // Back to frame coordinates, with a margin for the hair and the face borders
+        int marginX = rect.width / 4 + 1;
+        int marginY = rect.height / 4 + 1;
+        int x1 = MAX(0, (rect.x - marginX) * mReduction);
+        int y1 = MAX(0, (rect.y - marginY) * mReduction);
+        int x2 = MIN(cvImage->width, (rect.x + rect.width + marginX) * mReduction);
+        int y2 = MIN(cvImage->height, (rect.y + rect.height + marginY) * mReduction);
+        CvRect region = cvRect(x1, y1, x2 - x1, y2 - y1);
+
+        // Merge with the overlapping regions, so we don't search the same pixels twice
+        for(int i = 0; i < regions.size(); ) {
+            CvRect other = regions.at(i);
+            if(region.x < other.x + other.width && other.x < region.x + region.width &&
+               region.y < other.y + other.height && other.y < region.y + region.height) {
+                region = cvMaxRect(&region, &other);
+                regions.remove(i);
+                i = 0;
+            } else i++;
+        }
+        regions.append(region);
+    }
+
+    return regions;
+}
+
+void SkinFilter::setVMin(int vMin) {
+    mVMin = vMin;
+}
+
+void SkinFilter::setSMin(int sMin) {
+    mSMin = sMin;
+}
+
+int SkinFilter::vMin() const {
+    return mVMin;
+}
+
+int SkinFilter::sMin() const {
+    return mSMin;
+}
@@ -0,0 +1,67 @@
+/*
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef SKINFILTER_H
+#define SKINFILTER_H
+
+#include <QVector>
+
+#include "cv.h"
+
+#include "frameimages.h"
+
+// Cheap skin color prefilter for FaceDetect.
+// It back-projects a hue/saturation skin model over the reduced HSV view of the frame (FrameImages)
+// and returns the bounding rects of the connected skin regions, so the Haar cascade only runs there.
+class SkinFilter {
+    public:
+        SkinFilter();
+        ~SkinFilter();
+
+    public:
+        // Candidate regions in frame coordinates, the frame images must have the BGR frame
+        QVector<CvRect> candidateRegions(FrameImages *images);
+
+        // Parameter settings (shared with the CamShift calibration dialog)
+        void setVMin(int vMin);
+        void setSMin(int sMin);
+        int vMin() const;
+        int sMin() const;
+
+    private:
+        void createModel();
+        void updateImages(CvSize size);
+
+    private:
+        int mHistBins[2];           // Hue and Saturation bins of the skin model
+        float mHueRanges[2];
+        float mSatRanges[2];
+        int mVMin, mVMax;
+        int mSMin;                  // Limits for ignoring pixels too close to neutral
+        int mReduction;             // The frame is reduced by this factor before filtering
+        int mMinArea;               // Minimum area (in reduced pixels) of a candidate region
+
+        IplImage *mHueImg;          // Hue channel
+        IplImage *mSatImg;          // Saturation channel
+        IplImage *mMask;            // Pixels inside the vMin/sMin thresholds
+        IplImage *mProbImg;         // Skin probability for each pixel
+        CvHistogram *mHist;         // Hue/Saturation skin model
+        CvMemStorage *mStorage;     // Storage for the contours
+};
+
+#endif // SKINFILTER_H
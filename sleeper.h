@@ -0,0 +1,30 @@
+/*  
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+ 
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef SLEEPER_H
+#define SLEEPER_H
+
+#include <QThread>
+
+// QThread::msleep() is protected on Qt 4
+class Sleeper : public QThread {
+    public:
+        static void msleep(unsigned long ms) { QThread::msleep(ms); }
+};
+
+#endif // SLEEPER_H
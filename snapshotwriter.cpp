@@ -0,0 +1,124 @@
+/*
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include "snapshotwriter.h"
+
+#include <QMutexLocker>
+#include <QSettings>
+#include <QFileInfo>
+#include <string.h>
+
+SnapshotWriter::SnapshotWriter(QSize size, QImage::Format format, int buffers) : QThread() {
+    mDropped = 0;
+    mQuit = false;
+
+    QSettings settings("Kronen Software", "Qt + OpenCV");
+    mNextPicture = settings.value("Files/NextPicture", 0).toInt();
+
+    for(int i = 0; i < buffers; i++) {
+        mBuffers.append(QImage(size, format));
+        mFreeBuffers.append(i);
+    }
+
+    start(QThread::LowPriority);
+}
+
+// Saves the pending screenshots before stopping
+SnapshotWriter::~SnapshotWriter() {
+    {
+        QMutexLocker locker(&mMutex);
+        mQuit = true;
+        mJobAvailable.wakeOne();
+    }
+    wait();
+}
+
+bool SnapshotWriter::capture(const QImage &image) {
+    QMutexLocker locker(&mMutex);
+
+    if(mFreeBuffers.isEmpty() || image.size() != mBuffers.at(0).size() || image.format() != mBuffers.at(0).format()) {
+        mDropped++;
+        return false;
+    }
+
+    // The buffer is only ours until the writer takes it, copy the pixels without reallocating
+    int job = mFreeBuffers.takeFirst();
+    QImage &buffer = mBuffers[job];
+    memcpy(buffer.bits(), image.bits(), image.byteCount());
+
+    mJobs.enqueue(job);
+    mJobAvailable.wakeOne();
+    return true;
+}
+
+int SnapshotWriter::pending() const {
+    QMutexLocker locker(&mMutex);
+    return mJobs.size();
+}
+
+int SnapshotWriter::dropped() const {
+    QMutexLocker locker(&mMutex);
+    return mDropped;
+}
+
+void SnapshotWriter::run() {
+    QMutexLocker locker(&mMutex);
+
+    forever {
+        while(mJobs.isEmpty() && !mQuit) mJobAvailable.wait(&mMutex);
+        if(mJobs.isEmpty()) break;
+
+        int job = mJobs.dequeue();
+        QImage &buffer = mBuffers[job];
+
+        // Name and encode without holding the lock, the buffer isn't free until we finish. Only if the files
+        // were created by someone else we need more than one check
+        locker.unlock();
+        QString filename = QString("webcamPic%1.jpg").arg(mNextPicture++);
+        while(QFileInfo(filename).exists()) filename = QString("webcamPic%1.jpg").arg(mNextPicture++);
+        buffer.save(filename, "JPG", 80);
+        locker.relock();
+
+        mFreeBuffers.append(job);
+        if(mJobs.isEmpty()) {
+            locker.unlock();
+            saveCounter();
+            locker.relock();
+        }
+    }
+}
+
+// Once per burst, the writer thread has the counter
+void SnapshotWriter::saveCounter() {
+    QSettings settings("Kronen Software", "Qt + OpenCV");
+    settings.setValue("Files/NextPicture", mNextPicture);
+}
+
+QString SnapshotWriter::nextFileName(const QString &counter, const QString &pattern, int first) {
+    QSettings settings("Kronen Software", "Qt + OpenCV");
+    settings.beginGroup("Files");
+    int i = settings.value(counter, first).toInt();
+
+    // Only if the files were created by someone else we need more than one check
+    QString filename = pattern.arg(i);
+    while(QFileInfo(filename).exists()) filename = pattern.arg(++i);
+
+    settings.setValue(counter, i + 1);
+    settings.endGroup();
+    return filename;
+}
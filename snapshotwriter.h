@@ -0,0 +1,64 @@
+/*
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef SNAPSHOTWRITER_H
+#define SNAPSHOTWRITER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QImage>
+#include <QVector>
+#include <QQueue>
+
+// Encodes and saves the screenshots off the GUI thread.
+// capture() only copies the frame into a pooled buffer, so a burst of frames can be taken at full rate.
+// If all the buffers are waiting to be encoded the frame is dropped. The files are named by the writer
+// (webcamPic<n>.jpg), the counter is read from the settings once and saved when the queue empties.
+class SnapshotWriter : public QThread {
+    public:
+        SnapshotWriter(QSize size, QImage::Format format, int buffers = 10);
+        ~SnapshotWriter();
+
+    public:
+        bool capture(const QImage &image);
+        int pending() const;
+        int dropped() const;
+
+        // Next name of a sequence of files, the counter is kept on the settings so we never scan the directory
+        static QString nextFileName(const QString &counter, const QString &pattern, int first);
+
+    protected:
+        void run();
+
+    private:
+        void saveCounter();
+
+    private:
+
+        mutable QMutex mMutex;
+        QWaitCondition mJobAvailable;
+        QVector<QImage> mBuffers;
+        QList<int> mFreeBuffers;
+        QQueue<int> mJobs;          // Buffers to save, in order
+        int mNextPicture;           // Counter of the file names (writer thread)
+        int mDropped;
+        bool mQuit;
+};
+
+#endif // SNAPSHOTWRITER_H
@@ -0,0 +1,50 @@
+/*
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef STARTUP_H
+#define STARTUP_H
+
+#include <QThread>
+#include <QString>
+
+#include "cv.h"
+
+#include "facedetect.h"
+
+// Loads a cascade model on a background thread. The loader keeps a reference to the model until
+// it's deleted, so the FaceDetect instances set to the same file take it from the cache.
+class CascadeLoader : public QThread {
+    public:
+        CascadeLoader(const QString &cascadeFile);
+        ~CascadeLoader();
+
+    public:
+        QString cascadeFile() const;
+        bool isLoaded() const;
+        double loadTime() const;
+
+    protected:
+        void run();
+
+    private:
+        QString mCascadeFile;
+        CascadeModel *mModel;
+        double mLoadTime;
+};
+
+#endif // STARTUP_H
@@ -0,0 +1,253 @@
+/*
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include "tracklog.h"
+
+#include <string.h>
+
+static const char trackLogMagic[8] = { 'Q', 'C', 'V', 'T', 'R', 'K', '0', '1' };
+static const char trackLogIndexMagic[8] = { 'Q', 'C', 'V', 'T', 'R', 'K', 'I', 'X' };
+static const quint32 trackLogVersion = 2;      // 2: track ids on the boxes
+
+// Records are padded so the next one starts 8-byte aligned on the mapped file
+static qint64 alignedSize(qint64 size) {
+    return (size + 7) & ~(qint64)7;
+}
+
+TrackLog::TrackLog() {
+    mIndexInterval = 32;
+    mFrame = 0;
+}
+
+TrackLog::~TrackLog() {
+    close();
+}
+
+bool TrackLog::open(const QString &filename, CvSize size, int indexInterval) {
+    close();
+
+    mFile.setFileName(filename);
+    if(!mFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) return false;
+
+    mIndexInterval = MAX(1, indexInterval);
+    mFrame = 0;
+    mIndex.clear();
+
+    TrackLogHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, trackLogMagic, sizeof(header.magic));
+    header.version = trackLogVersion;
+    header.width = size.width;
+    header.height = size.height;
+    header.indexInterval = mIndexInterval;
+    mFile.write((const char *)&header, sizeof(header));
+
+    return true;
+}
+
+// Writes the seek index and the trailer pointing to it
+void TrackLog::close() {
+    if(!mFile.isOpen()) return;
+
+    TrackLogTrailer trailer;
+    memset(&trailer, 0, sizeof(trailer));
+    memcpy(trailer.magic, trackLogIndexMagic, sizeof(trailer.magic));
+    trailer.indexOffset = mFile.pos();
+    trailer.entries = mIndex.size();
+
+    if(!mIndex.isEmpty())
+        mFile.write((const char *)mIndex.constData(), mIndex.size() * sizeof(TrackLogIndexEntry));
+    mFile.write((const char *)&trailer, sizeof(trailer));
+
+    mFile.close();
+    mIndex.clear();
+}
+
+bool TrackLog::isOpen() const {
+    return mFile.isOpen();
+}
+
+void TrackLog::write(qint64 timestamp, const QVector<QRect> &faces, const CvBox2D *track, int trackId, int flags) {
+    if(!mFile.isOpen()) return;
+
+    TrackLogRecord record;
+    record.frame = mFrame;
+    record.faces = (quint16)MIN(faces.size(), 0xFFFF);
+    record.tracks = track ? 1 : 0;
+    record.flags = (quint8)flags;
+    record.timestamp = timestamp;
+
+    if(mFrame % mIndexInterval == 0) {
+        TrackLogIndexEntry entry;
+        entry.frame = mFrame;
+        entry.reserved = 0;
+        entry.timestamp = timestamp;
+        entry.offset = mFile.pos();
+        mIndex.append(entry);
+    }
+
+    qint64 size = sizeof(record);
+    mFile.write((const char *)&record, sizeof(record));
+
+    for(int i = 0; i < record.faces; i++) {
+        const QRect &face = faces.at(i);
+        TrackLogRect rect;
+        rect.x = face.x();
+        rect.y = face.y();
+        rect.width = face.width();
+        rect.height = face.height();
+        mFile.write((const char *)&rect, sizeof(rect));
+        size += sizeof(rect);
+    }
+
+    if(track) {
+        TrackLogBox box;
+        box.cx = track->center.x;
+        box.cy = track->center.y;
+        box.width = track->size.width;
+        box.height = track->size.height;
+        box.angle = track->angle;
+        box.id = trackId;
+        mFile.write((const char *)&box, sizeof(box));
+        size += sizeof(box);
+    }
+
+    static const char padding[8] = { 0 };
+    mFile.write(padding, alignedSize(size) - size);
+
+    mFrame++;
+}
+
+TrackLogReader::TrackLogReader() {
+    mData = 0;
+    mSize = 0;
+    mRecordsEnd = 0;
+    mIndex = 0;
+    mEntries = 0;
+}
+
+TrackLogReader::~TrackLogReader() {
+    close();
+}
+
+bool TrackLogReader::open(const QString &filename) {
+    close();
+
+    mFile.setFileName(filename);
+    if(!mFile.open(QIODevice::ReadOnly)) return false;
+
+    mSize = mFile.size();
+    if(mSize < (qint64)sizeof(TrackLogHeader) || !(mData = mFile.map(0, mSize))) {
+        close();
+        return false;
+    }
+
+    if(memcmp(header()->magic, trackLogMagic, sizeof(trackLogMagic)) != 0 || header()->version != trackLogVersion) {
+        close();
+        return false;
+    }
+
+    // Without a valid trailer (the recording wasn't closed) the records run to the end of the file
+    mRecordsEnd = mSize;
+    if(mSize >= (qint64)(sizeof(TrackLogHeader) + sizeof(TrackLogTrailer))) {
+        const TrackLogTrailer *trailer = (const TrackLogTrailer *)(mData + mSize - sizeof(TrackLogTrailer));
+        qint64 indexSize = (qint64)trailer->entries * sizeof(TrackLogIndexEntry);
+
+        if(memcmp(trailer->magic, trackLogIndexMagic, sizeof(trackLogIndexMagic)) == 0 &&
+           trailer->indexOffset >= (qint64)sizeof(TrackLogHeader) &&
+           trailer->indexOffset + indexSize + (qint64)sizeof(TrackLogTrailer) == mSize) {
+            mRecordsEnd = trailer->indexOffset;
+            mIndex = (const TrackLogIndexEntry *)(mData + trailer->indexOffset);
+            mEntries = trailer->entries;
+        }
+    }
+
+    return true;
+}
+
+void TrackLogReader::close() {
+    if(mData) mFile.unmap(mData);
+    mFile.close();
+
+    mData = 0;
+    mSize = 0;
+    mRecordsEnd = 0;
+    mIndex = 0;
+    mEntries = 0;
+}
+
+const TrackLogHeader *TrackLogReader::header() const {
+    return mData ? (const TrackLogHeader *)mData : 0;
+}
+
+// Binary search on the index for the last entry before the timestamp, then a short linear scan
+qint64 TrackLogReader::find(qint64 timestamp) const {
+    qint64 offset = firstRecord();
+
+    if(mEntries > 0) {
+        int low = 0, high = mEntries - 1;
+        if(mIndex[0].timestamp <= timestamp) {
+            while(low < high) {
+                int middle = (low + high + 1) / 2;
+                if(mIndex[middle].timestamp <= timestamp) low = middle;
+                    else high = middle - 1;
+            }
+            offset = mIndex[low].offset;
+        }
+    }
+
+    for(; offset >= 0; offset = nextRecord(offset))
+        if(record(offset)->timestamp >= timestamp) return offset;
+
+    return -1;
+}
+
+qint64 TrackLogReader::firstRecord() const {
+    return record(sizeof(TrackLogHeader)) ? (qint64)sizeof(TrackLogHeader) : -1;
+}
+
+qint64 TrackLogReader::nextRecord(qint64 offset) const {
+    const TrackLogRecord *current = record(offset);
+    if(!current) return -1;
+
+    offset += recordSize(current);
+    return record(offset) ? offset : -1;
+}
+
+// A record is only returned if it's complete, the last one may be truncated if the recording was interrupted
+const TrackLogRecord *TrackLogReader::record(qint64 offset) const {
+    if(!mData || offset < (qint64)sizeof(TrackLogHeader) || offset + (qint64)sizeof(TrackLogRecord) > mRecordsEnd)
+        return 0;
+
+    const TrackLogRecord *current = (const TrackLogRecord *)(mData + offset);
+    if(offset + recordSize(current) > mRecordsEnd) return 0;
+
+    return current;
+}
+
+const TrackLogRect *TrackLogReader::rects(const TrackLogRecord *record) {
+    return (const TrackLogRect *)(record + 1);
+}
+
+const TrackLogBox *TrackLogReader::boxes(const TrackLogRecord *record) {
+    return (const TrackLogBox *)(rects(record) + record->faces);
+}
+
+qint64 TrackLogReader::recordSize(const TrackLogRecord *record) {
+    return alignedSize(sizeof(TrackLogRecord) + record->faces * sizeof(TrackLogRect) + record->tracks * sizeof(TrackLogBox));
+}
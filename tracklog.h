@@ -0,0 +1,134 @@
+/*
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef TRACKLOG_H
+#define TRACKLOG_H
+
+#include <QFile>
+#include <QVector>
+#include <QRect>
+#include <QString>
+
+#include "cv.h"
+
+/* Side-car file of the detections and tracks of a recording (little-endian, every record 8-byte aligned):
+
+    TrackLogHeader
+    TrackLogRecord, faces x TrackLogRect, tracks x TrackLogBox, padding      (one per recorded frame)
+    ...
+    TrackLogIndexEntry x entries        (one every indexInterval frames)
+    TrackLogTrailer
+
+   The file can be memory-mapped: the trailer points to the seek index, so a tool can jump to any time
+   without reading the records before it. If the file wasn't closed (no trailer) the records can still be
+   read sequentially. */
+
+struct TrackLogHeader {
+    char magic[8];              // "QCVTRK01"
+    quint32 version;
+    quint32 width;
+    quint32 height;
+    quint32 indexInterval;
+    quint64 reserved;
+};
+
+struct TrackLogRecord {
+    enum Flags { FlippedH = 1, FlippedV = 2 };
+
+    quint32 frame;              // Frame index on the video
+    quint16 faces;
+    quint8 tracks;
+    quint8 flags;               // Flips applied to the image the coordinates refer to
+    qint64 timestamp;           // Microseconds since the recording started
+};
+
+struct TrackLogRect {
+    qint16 x, y, width, height;
+};
+
+struct TrackLogBox {
+    float cx, cy, width, height, angle;
+    qint32 id;                  // Track the box belongs to, the same face keeps it along the file
+};
+
+struct TrackLogIndexEntry {
+    quint32 frame;
+    quint32 reserved;
+    qint64 timestamp;
+    qint64 offset;              // Offset of the record on the file
+};
+
+struct TrackLogTrailer {
+    char magic[8];              // "QCVTRKIX"
+    qint64 indexOffset;
+    quint32 entries;
+    quint32 reserved;
+};
+
+// Append-only writer, used while recording a video
+class TrackLog {
+    public:
+        TrackLog();
+        ~TrackLog();
+
+    public:
+        bool open(const QString &filename, CvSize size, int indexInterval = 32);
+        void close();
+        bool isOpen() const;
+
+        void write(qint64 timestamp, const QVector<QRect> &faces, const CvBox2D *track, int trackId, int flags);
+
+    private:
+        QFile mFile;
+        QVector<TrackLogIndexEntry> mIndex;
+        int mIndexInterval;
+        quint32 mFrame;
+};
+
+// Memory-mapped reader
+class TrackLogReader {
+    public:
+        TrackLogReader();
+        ~TrackLogReader();
+
+    public:
+        bool open(const QString &filename);
+        void close();
+
+        const TrackLogHeader *header() const;
+
+        // Offset of the first record at or after the timestamp, -1 if there isn't any
+        qint64 find(qint64 timestamp) const;
+        qint64 firstRecord() const;
+        qint64 nextRecord(qint64 offset) const;     // -1 at the end
+        const TrackLogRecord *record(qint64 offset) const;
+
+        static const TrackLogRect *rects(const TrackLogRecord *record);
+        static const TrackLogBox *boxes(const TrackLogRecord *record);
+        static qint64 recordSize(const TrackLogRecord *record);
+
+    private:
+        QFile mFile;
+        uchar *mData;
+        qint64 mSize;
+        qint64 mRecordsEnd;         // Where the index starts (or the file size if there isn't index)
+        const TrackLogIndexEntry *mIndex;
+        int mEntries;
+};
+
+#endif // TRACKLOG_H
@@ -0,0 +1,379 @@
+/*
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include "videoanalysis.h"
+
+#include <QStringList>
+#include <QRectF>
+
+#include "frameqos.h"
+#include "frameimages.h"
+#include "facedetect.h"
+#include "camshift.h"
+#include "tracklog.h"
+
+// Detections in a row that don't touch the tracked box before the track is dropped
+static const int LostFrames = 8;
+
+// Overlap of two boxes over the smallest one, used to join the tracks of two segments
+static double boxOverlap(const CvBox2D &a, const CvBox2D &b) {
+    QRectF rectA(a.center.x - a.size.width / 2, a.center.y - a.size.height / 2, a.size.width, a.size.height);
+    QRectF rectB(b.center.x - b.size.width / 2, b.center.y - b.size.height / 2, b.size.width, b.size.height);
+    QRectF common = rectA & rectB;
+
+    double smallest = qMin(rectA.width() * rectA.height(), rectB.width() * rectB.height());
+    return smallest > 0 ? common.width() * common.height() / smallest : 0;
+}
+
+static bool touches(const QVector<QRect> &faces, const CvBox2D &box) {
+    QRect rect(qRound(box.center.x - box.size.width / 2), qRound(box.center.y - box.size.height / 2),
+               qRound(box.size.width), qRound(box.size.height));
+    foreach(QRect face, faces) if(face.intersects(rect)) return true;
+    return false;
+}
+
+// A thread of the analysis, with its own capture, detection context and tracker.
+// It takes segments until there are none left
+class AnalysisWorker : public QThread {
+    public:
+        AnalysisWorker(VideoAnalysis *analysis);
+        ~AnalysisWorker();
+
+    protected:
+        void run();
+
+    private:
+        friend class VideoAnalysis;
+
+        VideoAnalysis *mAnalysis;
+        CvCapture *mCapture;
+        int mPosition;              // Next frame the capture returns
+        bool mTracking;             // State of the tracker at mPosition
+        int mMissed;
+        IplImage *mFlipped;         // Bottom-left frames turned top-left
+        FaceDetect *mFaceDetect;
+        CamShift *mCamShift;
+        FrameImages *mFrameImages;
+};
+
+AnalysisWorker::AnalysisWorker(VideoAnalysis *analysis) : QThread() {
+    mAnalysis = analysis;
+    mCapture = 0;
+    mPosition = 0;
+    mTracking = false;
+    mMissed = 0;
+    mFlipped = 0;
+    mFaceDetect = 0;
+    mCamShift = 0;
+    mFrameImages = 0;
+}
+
+AnalysisWorker::~AnalysisWorker() {
+    wait();
+}
+
+void AnalysisWorker::run() {
+    mFaceDetect = new FaceDetect();
+    mFaceDetect->setCascadeFile(mAnalysis->mCascadeFile);
+    mCamShift = new CamShift(mAnalysis->mSize);
+    mFrameImages = new FrameImages();
+
+    AnalysisSegment *segment;
+    while((segment = mAnalysis->nextSegment(this))) mAnalysis->analyzeSegment(segment, this);
+
+    if(mCapture) cvReleaseCapture(&mCapture);
+    if(mFlipped) cvReleaseImage(&mFlipped);
+    delete mFrameImages;
+    delete mCamShift;
+    delete mFaceDetect;
+}
+
+
+VideoAnalysis::VideoAnalysis(const QString &videoFile, const QString &cascadeFile) {
+    mVideoFile = videoFile;
+    mCascadeFile = cascadeFile;
+    mSize = cvSize(0, 0);
+    mFps = 0;
+    mFrameCount = 0;
+    mSeekable = true;
+    mWorkers = 0;
+    mTracks = mJoined = 0;
+    mTime = 0;
+}
+
+bool VideoAnalysis::run(int workers, int keyframeInterval, int overlap) {
+    double start = FrameQoS::now();
+    mWorkers = qMax(1, workers);
+    keyframeInterval = qMax(1, keyframeInterval);
+
+    CvCapture *capture = cvCaptureFromFile(mVideoFile.toUtf8());
+    IplImage *frame = capture ? cvQueryFrame(capture) : 0;
+    if(!frame) {
+        mError = "Can't read the video " + mVideoFile;
+        if(capture) cvReleaseCapture(&capture);
+        return false;
+    }
+    mSize = cvGetSize(frame);
+    mFps = cvGetCaptureProperty(capture, CV_CAP_PROP_FPS);
+    mFrameCount = (int)cvGetCaptureProperty(capture, CV_CAP_PROP_FRAME_COUNT);
+    cvReleaseCapture(&capture);
+    if(mFps <= 0) mFps = 8;
+
+    // The model is loaded once here, the workers take it from the cache
+    CascadeModel *model = CascadeModel::acquire(mCascadeFile);
+    if(!model) {
+        mError = "Can't load the cascade " + mCascadeFile;
+        return false;
+    }
+
+    // Several segments per worker, so a worker that finishes early takes more. Their length and the overlap
+    // are multiples of the key frame interval. Without frame count the file is read in one segment
+    overlap = (overlap + keyframeInterval - 1) / keyframeInterval * keyframeInterval;
+    int length = mFrameCount;
+    if(mWorkers > 1 && mFrameCount > 0) {
+        length = (mFrameCount + mWorkers * 4 - 1) / (mWorkers * 4);
+        length = qMax(length, 4 * qMax(overlap, keyframeInterval));
+        length = (length + keyframeInterval - 1) / keyframeInterval * keyframeInterval;
+    }
+
+    mSegments.clear();
+    int first = 0;
+    do {
+        AnalysisSegment segment;
+        segment.start = first;
+        segment.end = (length > 0 && first + length < mFrameCount) ? first + length : -1;
+        segment.first = qMax(0, first - overlap);
+        segment.tracks = 0;
+        segment.time = 0;
+        segment.seeked = true;
+        segment.continued = false;
+        segment.taken = false;
+        mSegments.append(segment);
+        first = segment.end;
+    } while(first > 0);
+    mSeekable = true;
+
+    QList<AnalysisWorker *> threads;
+    for(int i = 0; i < qMin(mWorkers, mSegments.size()); i++) {
+        threads.append(new AnalysisWorker(this));
+        threads.last()->start();
+    }
+    qDeleteAll(threads);
+
+    CascadeModel::release(model);
+    stitch();
+    mTime = FrameQoS::now() - start;
+    return true;
+}
+
+// In order while the capture can seek. Otherwise the segment that continues the last one of the worker, or
+// the first free one ahead of it (reading forward is cheaper than from the first frame), or the first free one
+AnalysisSegment *VideoAnalysis::nextSegment(AnalysisWorker *worker) {
+    QMutexLocker locker(&mSegmentLock);
+    AnalysisSegment *first = 0, *ahead = 0;
+
+    for(int s = 0; s < mSegments.size(); s++) {
+        AnalysisSegment &segment = mSegments[s];
+        if(segment.taken) continue;
+        if(!first) first = &segment;
+        if(mSeekable) break;
+
+        if(segment.start == worker->mPosition) {
+            ahead = &segment;
+            break;
+        }
+        if(!ahead && segment.first > worker->mPosition) ahead = &segment;
+    }
+
+    AnalysisSegment *segment = ahead ? ahead : first;
+    if(segment) segment->taken = true;
+    return segment;
+}
+
+void VideoAnalysis::analyzeSegment(AnalysisSegment *segment, AnalysisWorker *worker) {
+    double start = FrameQoS::now();
+
+    if(!worker->mCapture) {
+        worker->mCapture = cvCaptureFromFile(mVideoFile.toUtf8());
+        worker->mPosition = 0;
+        worker->mTracking = false;
+    }
+    if(!worker->mCapture) return;
+
+    // Right after its last segment the worker goes on, the tracker already has the state of the boundary
+    segment->continued = segment->start > 0 && worker->mPosition == segment->start;
+    if(segment->continued) segment->first = segment->start;
+        else worker->mTracking = false;
+
+    // Seeking to a key frame is exact on the backends we use. If the capture lands elsewhere it's opened
+    // again and nobody seeks from then on
+    bool seekable;
+    {
+        QMutexLocker locker(&mSegmentLock);
+        seekable = mSeekable;
+    }
+    if(worker->mPosition != segment->first && seekable) {
+        cvSetCaptureProperty(worker->mCapture, CV_CAP_PROP_POS_FRAMES, segment->first);
+        worker->mPosition = (int)cvGetCaptureProperty(worker->mCapture, CV_CAP_PROP_POS_FRAMES);
+
+        if(worker->mPosition != segment->first) {
+            QMutexLocker locker(&mSegmentLock);
+            mSeekable = false;
+            locker.unlock();
+
+            cvReleaseCapture(&worker->mCapture);
+            worker->mCapture = cvCaptureFromFile(mVideoFile.toUtf8());
+            worker->mPosition = 0;
+        }
+    }
+
+    // Without seeking the frames before the segment are skipped, from the first frame only if it's behind
+    if(worker->mCapture && worker->mPosition != segment->first) {
+        segment->seeked = false;
+        if(worker->mPosition > segment->first) {
+            cvReleaseCapture(&worker->mCapture);
+            worker->mCapture = cvCaptureFromFile(mVideoFile.toUtf8());
+            worker->mPosition = 0;
+        }
+        for(; worker->mCapture && worker->mPosition < segment->first; worker->mPosition++)
+            if(!cvGrabFrame(worker->mCapture)) break;
+    }
+    if(!worker->mCapture) return;
+
+    // The tracker starts again on every segment, the overlap brings it to the state it has on the boundary.
+    // A continued segment keeps the track of the previous one, with a new local id
+    bool tracking = worker->mTracking;
+    int trackId = tracking ? segment->tracks++ : -1;
+    int missed = worker->mMissed;
+    CvRect trackRect = cvRect(0, 0, 0, 0);
+
+    for(int i = segment->first; segment->end < 0 || i < segment->end; i++) {
+        IplImage *frame = cvQueryFrame(worker->mCapture);
+        if(!frame) break;
+        worker->mPosition = i + 1;
+
+        if(frame->origin == IPL_ORIGIN_BL) {
+            if(!worker->mFlipped) worker->mFlipped = cvCreateImage(cvGetSize(frame), frame->depth, frame->nChannels);
+            cvFlip(frame, worker->mFlipped, 0);
+            frame = worker->mFlipped;
+        }
+
+        FrameImages *images = worker->mFrameImages;
+        images->setFrame(frame);
+        AnalysisFrame result;
+        result.faces = worker->mFaceDetect->detectFaces(images);
+        result.trackId = -1;
+
+        // Same tracking as the live view (the first face found), dropped when the detections keep missing it
+        if(!tracking && !result.faces.isEmpty()) {
+            QRect face = result.faces.at(0);
+            trackRect = cvRect(face.x(), face.y(), face.width(), face.height());
+            worker->mCamShift->startTracking(images, trackRect);
+            tracking = true;
+            trackId = segment->tracks++;
+            missed = 0;
+        } else if(tracking) {
+            result.track = worker->mCamShift->trackFace(images);
+            if(!result.faces.isEmpty()) missed = touches(result.faces, result.track) ? 0 : missed + 1;
+
+            if(result.track.size.width < 1 || result.track.size.height < 1 || missed >= LostFrames) tracking = false;
+            else result.trackId = trackId;
+        }
+
+        // The overlap only warms up the tracker
+        if(i >= segment->start) segment->frames.append(result);
+    }
+
+    worker->mTracking = tracking;
+    worker->mMissed = missed;
+    segment->time = FrameQoS::now() - start;
+}
+
+// Global track ids, in order. A track that reaches the first frame of a segment and overlaps the one on the
+// last frame of the previous segment is the same face
+void VideoAnalysis::stitch() {
+    mTracks = mJoined = 0;
+
+    for(int s = 0; s < mSegments.size(); s++) {
+        AnalysisSegment &segment = mSegments[s];
+        QVector<int> ids(segment.tracks, -1);
+
+        if(s > 0 && !segment.frames.isEmpty() && !mSegments.at(s - 1).frames.isEmpty()) {
+            const AnalysisFrame &last = mSegments.at(s - 1).frames.last();
+            const AnalysisFrame &first = segment.frames.first();
+            if(last.trackId >= 0 && first.trackId >= 0 && boxOverlap(last.track, first.track) > 0.5) {
+                ids[first.trackId] = last.trackId;
+                mJoined++;
+            }
+        }
+
+        for(int i = 0; i < segment.frames.size(); i++) {
+            AnalysisFrame &frame = segment.frames[i];
+            if(frame.trackId < 0) continue;
+            if(ids.at(frame.trackId) < 0) ids[frame.trackId] = mTracks++;
+            frame.trackId = ids.at(frame.trackId);
+        }
+    }
+}
+
+bool VideoAnalysis::writeLog(const QString &filename) {
+    TrackLog log;
+    if(!log.open(filename, mSize)) {
+        mError = "Can't write " + filename;
+        return false;
+    }
+
+    qint64 frames = 0;
+    foreach(const AnalysisSegment &segment, mSegments) {
+        foreach(const AnalysisFrame &frame, segment.frames) {
+            log.write(qint64(frames * 1000000 / mFps), frame.faces, frame.trackId >= 0 ? &frame.track : 0, frame.trackId, 0);
+            frames++;
+        }
+    }
+
+    log.close();
+    return true;
+}
+
+QString VideoAnalysis::report() const {
+    QStringList lines;
+    int frames = 0;
+    double work = 0;
+
+    for(int s = 0; s < mSegments.size(); s++) {
+        const AnalysisSegment &segment = mSegments.at(s);
+        lines << QString("segment %1: frames %2-%3 (from %4%5), %6 ms").arg(s).arg(segment.start)
+                 .arg(segment.start + segment.frames.size() - 1).arg(segment.first)
+                 .arg(segment.continued ? ", continued" : segment.seeked ? "" : ", skipped").arg(segment.time, 0, 'f', 0);
+        frames += segment.frames.size();
+        work += segment.time;
+    }
+
+    lines << QString("%1: %2 frames (%3 reported) at %4x%5 in %6 segments, %7 threads")
+             .arg(mVideoFile).arg(frames).arg(mFrameCount).arg(mSize.width).arg(mSize.height)
+             .arg(mSegments.size()).arg(mWorkers);
+    lines << QString("%1 ms (%2 fps), %3 ms of work, %4x speedup").arg(mTime, 0, 'f', 0)
+             .arg(mTime > 0 ? frames * 1000 / mTime : 0, 0, 'f', 1).arg(work, 0, 'f', 0)
+             .arg(mTime > 0 ? work / mTime : 0, 0, 'f', 2);
+    lines << QString("%1 tracks, %2 continued across segments").arg(mTracks).arg(mJoined);
+    return lines.join("\n");
+}
+
+QString VideoAnalysis::errorString() const {
+    return mError;
+}
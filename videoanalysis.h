@@ -0,0 +1,103 @@
+/*
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef VIDEOANALYSIS_H
+#define VIDEOANALYSIS_H
+
+#include <QString>
+#include <QVector>
+#include <QList>
+#include <QRect>
+#include <QMutex>
+#include <QThread>
+
+#include "cv.h"
+#include "highgui.h"
+
+/* Offline face detection and tracking of a recorded video, split in segments that are decoded and
+   processed by several threads at once. Each thread opens its own capture, detection context and tracker.
+
+   Segment boundaries are multiples of the key frame interval, so seeking to them doesn't decode from an
+   earlier key frame. Every segment also processes some frames before its start (the overlap) without
+   keeping their results: the tracker reaches the boundary in the same state as the previous segment,
+   and the stitching joins the tracks that continue on both sides. The results are written in order
+   to a track log (see tracklog.h), with the stitched track ids.
+
+   If the capture can't seek (it lands on another frame) the workers stop seeking: each one takes the
+   segment that follows its last one when it's free, with the tracker as it was on the boundary, and
+   otherwise reads forward to the next free segment. Only a segment behind the worker is read from the
+   first frame. */
+
+// Results of one frame
+struct AnalysisFrame {
+    QVector<QRect> faces;
+    CvBox2D track;
+    int trackId;                // -1 if there isn't a track
+};
+
+struct AnalysisSegment {
+    int start, end;             // Frames [start, end), end is -1 for "until the end of the file"
+    int first;                  // First frame decoded (start minus the overlap)
+    QVector<AnalysisFrame> frames;
+    int tracks;                 // Local track ids used
+    double time;                // Milliseconds to decode and process
+    bool seeked;                // The capture could seek to the first frame
+    bool continued;             // Read right after the previous segment by the same worker, without overlap
+    bool taken;
+};
+
+class AnalysisWorker;
+
+class VideoAnalysis {
+    public:
+        VideoAnalysis(const QString &videoFile, const QString &cascadeFile);
+
+    public:
+        // keyframeInterval: the GOP of the video, 12 for the ones we record (FFmpeg's default)
+        bool run(int workers, int keyframeInterval = 12, int overlap = 24);
+        bool writeLog(const QString &filename);
+
+        QString report() const;
+        QString errorString() const;
+
+    private:
+        friend class AnalysisWorker;
+        AnalysisSegment *nextSegment(AnalysisWorker *worker);
+        void analyzeSegment(AnalysisSegment *segment, AnalysisWorker *worker);
+        void stitch();
+
+    private:
+        QString mVideoFile;
+        QString mCascadeFile;
+        QString mError;
+
+        CvSize mSize;
+        double mFps;
+        int mFrameCount;            // As reported by the container, it may be approximate
+
+        QList<AnalysisSegment> mSegments;
+        QMutex mSegmentLock;
+        bool mSeekable;             // No seek has missed yet
+
+        int mWorkers;
+        int mTracks;                // Tracks after stitching
+        int mJoined;                // Tracks that continued across a boundary
+        double mTime;               // Wall time of run()
+};
+
+#endif // VIDEOANALYSIS_H
@@ -0,0 +1,136 @@
+/*
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include "visionkernels.h"
+
+#ifdef VISION_SSE2
+#include <emmintrin.h>
+#endif
+#ifdef VISION_AVX2
+#include <immintrin.h>
+#endif
+
+// GCC and Clang compile each variant for its instruction set without flags for the whole file
+#if defined(__GNUC__) || defined(__clang__)
+#define VISION_TARGET(isa) __attribute__((target(isa)))
+#else
+#define VISION_TARGET(isa)
+#endif
+
+void rowMomentsScalar(const uchar *prob, int width, RowMoments *moments) {
+    int sum0 = 0;
+    qint64 sum1 = 0, sum2 = 0;
+
+    for(int x = 0; x < width; x++) {
+        int p = prob[x];
+        sum0 += p;
+        sum1 += p * x;
+        sum2 += (qint64)(p * x) * x;
+    }
+
+    moments->sum0 = sum0;
+    moments->sum1 = sum1;
+    moments->sum2 = sum2;
+}
+
+#ifdef VISION_SSE2
+// 4 pixels per step in 32 bit lanes. p * x fits in 16 x 16 bits, so _mm_madd_epi16 does it (the high halves
+// are 0); it's summed in 64 bit lanes, and the 64 bit p * x * x comes from _mm_mul_epu32 on the even and then
+// the odd lanes
+VISION_TARGET("sse2")
+void rowMomentsSSE2(const uchar *prob, int width, RowMoments *moments) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i step = _mm_set1_epi32(4);
+    __m128i xs = _mm_setr_epi32(0, 1, 2, 3);
+    __m128i acc0 = zero, acc1 = zero, acc2 = zero;
+
+    int x = 0;
+    for(; x + 4 <= width; x += 4) {
+        int bytes = prob[x] | prob[x + 1] << 8 | prob[x + 2] << 16 | prob[x + 3] << 24;
+        __m128i p = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero), zero);
+        __m128i px = _mm_madd_epi16(p, xs);
+
+        acc0 = _mm_add_epi32(acc0, p);
+        acc1 = _mm_add_epi64(acc1, _mm_unpacklo_epi32(px, zero));
+        acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(px, zero));
+        acc2 = _mm_add_epi64(acc2, _mm_mul_epu32(px, xs));
+        acc2 = _mm_add_epi64(acc2, _mm_mul_epu32(_mm_srli_epi64(px, 32), _mm_srli_epi64(xs, 32)));
+        xs = _mm_add_epi32(xs, step);
+    }
+
+    int sums0[4];
+    qint64 sums1[2], sums2[2];
+    _mm_storeu_si128((__m128i *)sums0, acc0);
+    _mm_storeu_si128((__m128i *)sums1, acc1);
+    _mm_storeu_si128((__m128i *)sums2, acc2);
+
+    RowMoments tail;
+    rowMomentsScalar(prob + x, width - x, &tail);
+
+    // The tail was summed from 0, move it to x
+    moments->sum0 = sums0[0] + sums0[1] + sums0[2] + sums0[3] + tail.sum0;
+    moments->sum1 = sums1[0] + sums1[1] + tail.sum1 + (qint64)tail.sum0 * x;
+    moments->sum2 = sums2[0] + sums2[1] + tail.sum2 + 2 * (qint64)x * tail.sum1 + (qint64)x * x * tail.sum0;
+}
+#endif
+
+#ifdef VISION_AVX2
+// Same as the SSE2 variant with 8 pixels per step
+VISION_TARGET("avx2")
+void rowMomentsAVX2(const uchar *prob, int width, RowMoments *moments) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i step = _mm256_set1_epi32(8);
+    __m256i xs = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i acc0 = zero, acc1 = zero, acc2 = zero;
+
+    int x = 0;
+    for(; x + 8 <= width; x += 8) {
+        __m256i p = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(prob + x)));
+        __m256i px = _mm256_mullo_epi32(p, xs);
+
+        acc0 = _mm256_add_epi32(acc0, p);
+        acc1 = _mm256_add_epi64(acc1, _mm256_unpacklo_epi32(px, zero));
+        acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(px, zero));
+        acc2 = _mm256_add_epi64(acc2, _mm256_mul_epu32(px, xs));
+        acc2 = _mm256_add_epi64(acc2, _mm256_mul_epu32(_mm256_srli_epi64(px, 32), _mm256_srli_epi64(xs, 32)));
+        xs = _mm256_add_epi32(xs, step);
+    }
+
+    int sums0[8];
+    qint64 sums1[4], sums2[4];
+    _mm256_storeu_si256((__m256i *)sums0, acc0);
+    _mm256_storeu_si256((__m256i *)sums1, acc1);
+    _mm256_storeu_si256((__m256i *)sums2, acc2);
+
+    RowMoments tail;
+    rowMomentsScalar(prob + x, width - x, &tail);
+
+    int sum0 = tail.sum0;
+    qint64 sum1 = tail.sum1 + (qint64)tail.sum0 * x;
+    qint64 sum2 = tail.sum2 + 2 * (qint64)x * tail.sum1 + (qint64)x * x * tail.sum0;
+    for(int i = 0; i < 8; i++) sum0 += sums0[i];
+    for(int i = 0; i < 4; i++) {
+        sum1 += sums1[i];
+        sum2 += sums2[i];
+    }
+
+    moments->sum0 = sum0;
+    moments->sum1 = sum1;
+    moments->sum2 = sum2;
+}
+#endif
@@ -0,0 +1,56 @@
+/*
+    Author: Alberto G. Lagos (Kronen)
+    Copyright (C) 2010  Alberto G. Lagos (Kronen)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#ifndef VISIONKERNELS_H
+#define VISIONKERNELS_H
+
+#include <QtGlobal>
+
+// Hand-written kernels of the hot loops, one implementation per instruction set. The scalar one is the
+// reference: every other variant must give bit-identical results (see KernelCheck). CpuDispatch binds
+// the best one the CPU supports.
+
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64)
+#if defined(_MSC_VER) || defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+#define VISION_SSE2
+#if !defined(_MSC_VER) || _MSC_VER >= 1700
+#define VISION_AVX2
+#endif
+#endif
+#endif
+
+// Integer moments of a row of face probabilities, x being the position on the row:
+// sum0 = sum(p), sum1 = sum(p * x), sum2 = sum(p * x * x). Rows are shorter than 32768 pixels (the SSE2
+// variant multiplies x in 16 bits), so sum0 fits in 32 bits; sum1 doesn't past some 4100 pixels
+struct RowMoments {
+    int sum0;
+    qint64 sum1;
+    qint64 sum2;
+};
+
+typedef void (*RowMomentsKernel)(const uchar *prob, int width, RowMoments *moments);
+
+void rowMomentsScalar(const uchar *prob, int width, RowMoments *moments);
+#ifdef VISION_SSE2
+void rowMomentsSSE2(const uchar *prob, int width, RowMoments *moments);
+#endif
+#ifdef VISION_AVX2
+void rowMomentsAVX2(const uchar *prob, int width, RowMoments *moments);
+#endif
+
+#endif // VISIONKERNELS_H